@@ -0,0 +1,89 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  /// An axis-aligned box.
+  struct BoundingBox
+  {
+    /// The corner with the smallest coordinates.
+    Vector3 min;
+
+    /// The corner with the largest coordinates.
+    Vector3 max;
+
+    inline Vector3 GetCentre() const
+    {
+      return (min + max) * 0.5f;
+    }
+
+    inline float GetSurfaceArea() const
+    {
+      const Vector3 size = max - min;
+      return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    /// Returns whether the ray (given by its origin and the reciprocal
+    /// of its direction) enters the box before maxDistance, and if so,
+    /// the distance at which it does so.
+    inline bool Intersect(const Vector3 origin, const Vector3 invDirection,
+                          const float maxDistance, float& distance) const
+    {
+      // Clip the ray against the three slabs of the box.
+      const Vector3 t1 = { (min.x - origin.x) * invDirection.x,
+                           (min.y - origin.y) * invDirection.y,
+                           (min.z - origin.z) * invDirection.z };
+      const Vector3 t2 = { (max.x - origin.x) * invDirection.x,
+                           (max.y - origin.y) * invDirection.y,
+                           (max.z - origin.z) * invDirection.z };
+      const Vector3 tNear = Min(t1, t2);
+      const Vector3 tFar  = Max(t1, t2);
+
+      distance = std::fmax(std::fmax(tNear.x, tNear.y), tNear.z);
+      const float exit = std::fmin(std::fmin(tFar.x, tFar.y), tFar.z);
+
+      return distance <= exit && exit >= 0.0f && distance < maxDistance;
+    }
+  };
+
+  /// Returns the smallest box that contains both boxes.
+  inline BoundingBox Union(const BoundingBox a, const BoundingBox b)
+  {
+    BoundingBox box = { Min(a.min, b.min), Max(a.max, b.max) };
+    return box;
+  }
+
+  /// Returns the box that is contained by both boxes.
+  inline BoundingBox Overlap(const BoundingBox a, const BoundingBox b)
+  {
+    BoundingBox box = { Max(a.min, b.min), Min(a.max, b.max) };
+    return box;
+  }
+
+  /// Returns a box that contains nothing, so that the union with
+  /// another box is that box.
+  inline BoundingBox EmptyBoundingBox()
+  {
+    const float inf = 1.0e30f;
+    BoundingBox box = { MakeVector3(inf, inf, inf),
+                        MakeVector3(-inf, -inf, -inf) };
+    return box;
+  }
+}
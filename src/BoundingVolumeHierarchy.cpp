@@ -0,0 +1,279 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+
+using namespace Luculentus;
+
+// The cost of visiting a node, relative to intersecting a primitive.
+const float traversalCost = 0.5f;
+
+// Leaves never hold more primitives than this.
+const int maxLeafSize = 8;
+
+void BoundingVolumeHierarchy::Build(const std::vector<BoundingBox>& boxes)
+{
+  nodes.clear();
+  wideNodes.clear();
+  primitives.clear();
+  depth = 0;
+  if (boxes.empty()) return;
+
+  std::vector<BuildItem> items;
+  items.reserve(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    BuildItem item = { boxes[i], boxes[i].GetCentre(), static_cast<int>(i) };
+    items.push_back(item);
+  }
+
+  BuildNode(items, 0, static_cast<int>(items.size()));
+
+  // The order of the items is now the order in which leaves refer to them
+  for (auto& item : items) primitives.push_back(item.index);
+
+  // Then flatten the binary tree into a wide one
+  CollapseNode(0, 1);
+}
+
+// Returns the component of the vector along the axis (0, 1 or 2).
+float GetComponent(const Vector3 v, const int axis)
+{
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+void BoundingVolumeHierarchy::BuildNode(std::vector<BuildItem>& items,
+                                        const int begin, const int end)
+{
+  const int count = end - begin;
+  const int nodeIndex = static_cast<int>(nodes.size());
+
+  Node node;
+  node.box = EmptyBoundingBox();
+  for (int i = begin; i < end; i++) node.box = Union(node.box, items[i].box);
+  nodes.push_back(node);
+
+  // Try splitting along every axis. The items are sorted by their
+  // centre, and every position in between is a candidate split. The
+  // surface area heuristic estimates the cost of a split as the number
+  // of primitives on each side, weighted by the probability that a ray
+  // that hits this node, hits the child as well.
+  const float leafCost = static_cast<float>(count);
+  float bestCost = leafCost;
+  int bestAxis = -1;
+  int bestSplit = 0;
+
+  if (count > 1)
+  {
+    std::vector<float> rightAreas(count);
+    const float invArea = 1.0f / std::fmax(node.box.GetSurfaceArea(), 1.0e-12f);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+      std::sort(items.begin() + begin, items.begin() + end,
+                [axis](const BuildItem& a, const BuildItem& b)
+                { return GetComponent(a.centre, axis)
+                       < GetComponent(b.centre, axis); });
+
+      // Sweep from the right to find the area of every right part
+      BoundingBox right = EmptyBoundingBox();
+      for (int i = count - 1; i > 0; i--)
+      {
+        right = Union(right, items[begin + i].box);
+        rightAreas[i] = right.GetSurfaceArea();
+      }
+
+      // And then sweep from the left to evaluate every split
+      BoundingBox left = EmptyBoundingBox();
+      for (int i = 1; i < count; i++)
+      {
+        left = Union(left, items[begin + i - 1].box);
+        const float cost = traversalCost + invArea
+          * (left.GetSurfaceArea() * i + rightAreas[i] * (count - i));
+
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = i;
+        }
+      }
+    }
+  }
+
+  // If splitting is not worth it, and the leaf is not too big, make a
+  // leaf. A big leaf is split in the middle if no split is better.
+  if (bestAxis == -1 && count <= maxLeafSize)
+  {
+    nodes[nodeIndex].offset = begin;
+    nodes[nodeIndex].count = count;
+    return;
+  }
+
+  if (bestAxis == -1)
+  {
+    bestAxis = 0;
+    bestSplit = count / 2;
+  }
+
+  // Restore the order of the best axis, and build the children
+  std::sort(items.begin() + begin, items.begin() + end,
+            [bestAxis](const BuildItem& a, const BuildItem& b)
+            { return GetComponent(a.centre, bestAxis)
+                   < GetComponent(b.centre, bestAxis); });
+
+  BuildNode(items, begin, begin + bestSplit);
+  nodes[nodeIndex].offset = static_cast<int>(nodes.size());
+  nodes[nodeIndex].count = 0;
+  BuildNode(items, begin + bestSplit, end);
+}
+
+int BoundingVolumeHierarchy::CollapseNode(const int node, const int level)
+{
+  const int wideIndex = static_cast<int>(wideNodes.size());
+  wideNodes.push_back(WideNode());
+  depth = std::max(depth, level);
+
+  // Start with the children of the binary node (a leaf is its own only
+  // child), and keep replacing the interior child with the largest
+  // surface area by its two children, until the node is full.
+  std::vector<int> children;
+  if (nodes[node].count > 0) children.push_back(node);
+  else { children.push_back(node + 1); children.push_back(nodes[node].offset); }
+
+  while (static_cast<int>(children.size()) < width)
+  {
+    int largest = -1;
+    float largestArea = -1.0f;
+    for (size_t i = 0; i < children.size(); i++)
+    {
+      const Node& child = nodes[children[i]];
+      if (child.count == 0 && child.box.GetSurfaceArea() > largestArea)
+      {
+        largestArea = child.box.GetSurfaceArea();
+        largest = static_cast<int>(i);
+      }
+    }
+
+    // Stop if all children are leaves
+    if (largest == -1) break;
+
+    const int expanded = children[largest];
+    children[largest] = expanded + 1;
+    children.push_back(nodes[expanded].offset);
+  }
+
+  // Unused slots get a degenerate box very far away, which no ray can
+  // enter before the maximum distance. (An empty box with the minimum
+  // larger than the maximum would appear infinite to the slab test.)
+  const float far = 1.0e18f;
+  const BoundingBox unused = { MakeVector3(far, far, far),
+                               MakeVector3(far, far, far) };
+
+  // Fill the slots, interior children become wide nodes themselves
+  for (int i = 0; i < width; i++)
+  {
+    const bool used = i < static_cast<int>(children.size());
+    const BoundingBox box = used ? nodes[children[i]].box : unused;
+    int offset = -1;
+    int count = 0;
+
+    if (used && nodes[children[i]].count > 0)
+    {
+      offset = nodes[children[i]].offset;
+      count = nodes[children[i]].count;
+    }
+    else if (used)
+    {
+      offset = CollapseNode(children[i], level + 1);
+    }
+
+    // Note that collapsing may have reallocated the wide nodes
+    WideNode& wideNode = wideNodes[wideIndex];
+    wideNode.minX[i] = box.min.x;
+    wideNode.minY[i] = box.min.y;
+    wideNode.minZ[i] = box.min.z;
+    wideNode.maxX[i] = box.max.x;
+    wideNode.maxY[i] = box.max.y;
+    wideNode.maxZ[i] = box.max.z;
+    wideNode.offset[i] = offset;
+    wideNode.count[i] = count;
+  }
+
+  return wideIndex;
+}
+
+// Stores the bounds of the product of values in the intervals [a0, a1]
+// and [b0, b1].
+void MultiplyIntervals(const float a0, const float a1,
+                       const float b0, const float b1,
+                       float& low, float& high)
+{
+  const float p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  low  = std::fmin(std::fmin(p00, p01), std::fmin(p10, p11));
+  high = std::fmax(std::fmax(p00, p01), std::fmax(p10, p11));
+}
+
+// Stores a lower bound of the distance at which a ray enters the slab
+// [min, max], and an upper bound of the distance at which it leaves,
+// for all rays with origins and reciprocal directions in the intervals.
+void ClipSlab(const float min, const float max,
+              const float originMin, const float originMax,
+              const float invDirectionMin, const float invDirectionMax,
+              float& entry, float& exit)
+{
+  // Rays in the positive direction enter at the minimum, others enter
+  // at the maximum of the slab
+  const bool positive = invDirectionMin > 0.0f;
+  const float near = positive ? min : max;
+  const float far  = positive ? max : min;
+
+  float low, high;
+  MultiplyIntervals(near - originMax, near - originMin,
+                    invDirectionMin, invDirectionMax, low, high);
+  entry = low;
+  MultiplyIntervals(far - originMax, far - originMin,
+                    invDirectionMin, invDirectionMax, low, high);
+  exit = high;
+}
+
+int BoundingVolumeHierarchy::IntersectChildrenBounds(const WideNode& node,
+  const Vector3 originMin, const Vector3 originMax,
+  const Vector3 invDirectionMin, const Vector3 invDirectionMax,
+  const float maxDistance)
+{
+  int mask = 0;
+  for (int i = 0; i < width; i++)
+  {
+    float entryX, exitX, entryY, exitY, entryZ, exitZ;
+    ClipSlab(node.minX[i], node.maxX[i], originMin.x, originMax.x,
+             invDirectionMin.x, invDirectionMax.x, entryX, exitX);
+    ClipSlab(node.minY[i], node.maxY[i], originMin.y, originMax.y,
+             invDirectionMin.y, invDirectionMax.y, entryY, exitY);
+    ClipSlab(node.minZ[i], node.maxZ[i], originMin.z, originMax.z,
+             invDirectionMin.z, invDirectionMax.z, entryZ, exitZ);
+
+    // No ray can enter later than this, or leave earlier
+    const float entry = std::fmax(std::fmax(entryX, entryY), entryZ);
+    const float exit  = std::fmin(std::fmin(exitX, exitY), exitZ);
+
+    if (entry <= exit && exit >= 0.0f && entry < maxDistance)
+      mask |= 1 << i;
+  }
+  return mask;
+}
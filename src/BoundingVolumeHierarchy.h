@@ -0,0 +1,446 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "BoundingBox.h"
+#include "Ray.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace Luculentus
+{
+  /// A tree of bounding boxes over a set of primitives, built with the
+  /// surface area heuristic, so that a ray only has to be tested against
+  /// the primitives near its path. The tree is built as a binary tree,
+  /// and then collapsed into a wide tree, of which the children of a
+  /// node can be tested against a ray simultaneously.
+  class BoundingVolumeHierarchy
+  {
+    public:
+
+      /// The number of children of a node in the wide tree: one for
+      /// every lane of a vector register.
+      #if defined(__AVX2__)
+      static const int width = 8;
+      #else
+      static const int width = 4;
+      #endif
+
+      struct Node
+      {
+        /// The box that contains all primitives below this node.
+        BoundingBox box;
+
+        /// For a leaf, the index of its first primitive in the
+        /// primitives array. For an interior node, the index of its
+        /// second child; the first child directly follows the node.
+        int offset;
+
+        /// The number of primitives in a leaf, zero for interior nodes.
+        int count;
+      };
+
+      /// A node of the wide tree. The child boxes are stored per
+      /// component, so that one vector instruction handles one
+      /// component of all children.
+      struct WideNode
+      {
+        float minX[width], minY[width], minZ[width];
+        float maxX[width], maxY[width], maxZ[width];
+
+        /// For a leaf child, the index of its first primitive in the
+        /// primitives array, otherwise the index of the child node.
+        int offset[width];
+
+        /// The number of primitives of a leaf child, zero for interior
+        /// children. Unused slots have a box far away, so they are
+        /// never hit.
+        int count[width];
+      };
+
+      /// The nodes of the binary tree, in depth-first order, the root
+      /// first.
+      std::vector<Node> nodes;
+
+      /// The nodes of the wide tree, the root first.
+      std::vector<WideNode> wideNodes;
+
+      /// The indices of the primitives, ordered such that every leaf
+      /// references a contiguous range.
+      std::vector<int> primitives;
+
+      /// The number of levels of the wide tree.
+      int depth;
+
+      /// Builds the hierarchy over primitives with the specified boxes.
+      /// Primitive indices refer to positions in this array.
+      void Build(const std::vector<BoundingBox>& boxes);
+
+      /// Visits the leaves that the ray might hit, nearest first. For
+      /// every leaf, intersectLeaf(offset, count, maxDistance) is called
+      /// with the range of the leaf in the primitives array, which
+      /// should lower maxDistance if a primitive is hit nearer. Boxes
+      /// beyond maxDistance are skipped.
+      template <typename IntersectLeaf>
+      void Traverse(const Ray ray, float& maxDistance,
+                    IntersectLeaf intersectLeaf) const;
+
+      /// The maximum number of rays in a packet.
+      static const int maxPacketSize = 16;
+
+      /// Like Traverse, but for a packet of coherent rays, such as
+      /// camera rays through a small part of the screen. Every ray has
+      /// its own maximum distance. For every leaf, intersectLeaf(offset,
+      /// count, rayMask) is called, with a bit set in the mask for
+      /// every ray that might hit the leaf.
+      template <typename IntersectLeaf>
+      void TraversePacket(const Ray* rays, const int size,
+                          float* maxDistances,
+                          IntersectLeaf intersectLeaf) const;
+
+    private:
+
+      /// A primitive while building.
+      struct BuildItem
+      {
+        BoundingBox box;
+        Vector3 centre;
+        int index;
+      };
+
+      /// Recursively builds the node for the items in the range, and
+      /// appends it and its children to the nodes.
+      void BuildNode(std::vector<BuildItem>& items,
+                     const int begin, const int end);
+
+      /// Recursively converts the binary node and its descendants into
+      /// wide nodes, and returns the index of the wide node. The level
+      /// of the root is one.
+      int CollapseNode(const int node, const int level);
+
+      /// The number of entries on the traversal stack that fit on the
+      /// program stack. Deeper trees use a stack on the heap.
+      static const int fixedStackSize = width * 32;
+
+      /// Tests the ray against all children of the wide node. Returns a
+      /// bit mask of the children that are entered before maxDistance,
+      /// and stores the entry distances.
+      static int IntersectChildren(const WideNode& node,
+                                   const Vector3 origin,
+                                   const Vector3 invDirection,
+                                   const float maxDistance,
+                                   float* distances);
+
+      /// Returns a bit mask of the children of the wide node that might
+      /// be hit by a ray with origin and reciprocal direction within the
+      /// specified bounds, before maxDistance. The reciprocal directions
+      /// must have the same sign for every ray. Children that are not
+      /// in the mask are certainly missed by all rays.
+      static int IntersectChildrenBounds(const WideNode& node,
+                                         const Vector3 originMin,
+                                         const Vector3 originMax,
+                                         const Vector3 invDirectionMin,
+                                         const Vector3 invDirectionMax,
+                                         const float maxDistance);
+  };
+
+  /// Returns the reciprocal of the direction, with components that are
+  /// (almost) zero replaced by a huge number, so that slab tests never
+  /// have to deal with infinities.
+  inline Vector3 GetInverseDirection(const Vector3 direction)
+  {
+    const float tiny = 1.0e-20f;
+    const Vector3 inv =
+    {
+      1.0f / (std::abs(direction.x) > tiny ? direction.x : tiny),
+      1.0f / (std::abs(direction.y) > tiny ? direction.y : tiny),
+      1.0f / (std::abs(direction.z) > tiny ? direction.z : tiny)
+    };
+    return inv;
+  }
+
+  inline int BoundingVolumeHierarchy::IntersectChildren(
+    const WideNode& node, const Vector3 origin, const Vector3 invDirection,
+    const float maxDistance, float* distances)
+  {
+    // Clip the ray against the three slabs of every child box, exactly
+    // like BoundingBox::Intersect does for a single box.
+#if defined(__AVX2__)
+    const __m256 ox = _mm256_set1_ps(origin.x);
+    const __m256 oy = _mm256_set1_ps(origin.y);
+    const __m256 oz = _mm256_set1_ps(origin.z);
+    const __m256 ix = _mm256_set1_ps(invDirection.x);
+    const __m256 iy = _mm256_set1_ps(invDirection.y);
+    const __m256 iz = _mm256_set1_ps(invDirection.z);
+
+    const __m256 x1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minX), ox), ix);
+    const __m256 x2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxX), ox), ix);
+    const __m256 y1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minY), oy), iy);
+    const __m256 y2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxY), oy), iy);
+    const __m256 z1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minZ), oz), iz);
+    const __m256 z2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxZ), oz), iz);
+
+    const __m256 entry = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(x1, x2),
+      _mm256_min_ps(y1, y2)), _mm256_min_ps(z1, z2));
+    const __m256 exit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(x1, x2),
+      _mm256_max_ps(y1, y2)), _mm256_max_ps(z1, z2));
+
+    const __m256 hit = _mm256_and_ps(_mm256_and_ps(
+      _mm256_cmp_ps(entry, exit, _CMP_LE_OQ),
+      _mm256_cmp_ps(exit, _mm256_setzero_ps(), _CMP_GE_OQ)),
+      _mm256_cmp_ps(entry, _mm256_set1_ps(maxDistance), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(distances, entry);
+    return _mm256_movemask_ps(hit);
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 ox = _mm_set1_ps(origin.x);
+    const __m128 oy = _mm_set1_ps(origin.y);
+    const __m128 oz = _mm_set1_ps(origin.z);
+    const __m128 ix = _mm_set1_ps(invDirection.x);
+    const __m128 iy = _mm_set1_ps(invDirection.y);
+    const __m128 iz = _mm_set1_ps(invDirection.z);
+
+    const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+    const __m128 x2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+    const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+    const __m128 y2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+    const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+    const __m128 z2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+
+    const __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(x1, x2),
+      _mm_min_ps(y1, y2)), _mm_min_ps(z1, z2));
+    const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x1, x2),
+      _mm_max_ps(y1, y2)), _mm_max_ps(z1, z2));
+
+    const __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(entry, exit),
+      _mm_cmpge_ps(exit, _mm_setzero_ps())),
+      _mm_cmplt_ps(entry, _mm_set1_ps(maxDistance)));
+
+    _mm_storeu_ps(distances, entry);
+    return _mm_movemask_ps(hit);
+#else
+    int mask = 0;
+    for (int i = 0; i < width; i++)
+    {
+      const BoundingBox box =
+      {
+        MakeVector3(node.minX[i], node.minY[i], node.minZ[i]),
+        MakeVector3(node.maxX[i], node.maxY[i], node.maxZ[i])
+      };
+      if (box.Intersect(origin, invDirection, maxDistance, distances[i]))
+        mask |= 1 << i;
+    }
+    return mask;
+#endif
+  }
+
+  template <typename IntersectLeaf>
+  void BoundingVolumeHierarchy::Traverse(const Ray ray,
+    float& maxDistance, IntersectLeaf intersectLeaf) const
+  {
+    if (wideNodes.empty()) return;
+
+    const Vector3 invDirection = GetInverseDirection(ray.direction);
+
+    // The children that still have to be visited, with the distance at
+    // which the ray enters them
+    struct StackEntry { int offset; int count; float distance; };
+    StackEntry fixedStack[fixedStackSize];
+    std::vector<StackEntry> heapStack;
+    StackEntry* stack = fixedStack;
+    int stackSize = 0;
+
+    // Every level adds at most all but one children of the node that
+    // was popped
+    if (width * depth > fixedStackSize)
+    {
+      heapStack.resize(width * depth);
+      stack = heapStack.data();
+    }
+
+    const StackEntry root = { 0, 0, 0.0f };
+    stack[stackSize++] = root;
+
+    while (stackSize > 0)
+    {
+      const StackEntry entry = stack[--stackSize];
+
+      // A nearer hit might have been found since the child was pushed
+      if (entry.distance >= maxDistance) continue;
+
+      // Intersect all primitives in a leaf, every hit makes the range
+      // of interest shorter
+      if (entry.count > 0)
+      {
+        intersectLeaf(entry.offset, entry.count, maxDistance);
+        continue;
+      }
+
+      // For interior nodes, find out which children are hit
+      const WideNode& node = wideNodes[entry.offset];
+      float distances[width];
+      int mask = IntersectChildren(node, ray.origin, invDirection,
+                                   maxDistance, distances);
+
+      // Order the hit children from far to near, so that the near
+      // children are popped first, and the far ones can perhaps be
+      // culled afterwards
+      StackEntry* const children = stack + stackSize;
+      int n = 0;
+      for (; mask != 0; mask &= mask - 1)
+      {
+        int i = 0;
+        while (!(mask & (1 << i))) i++;
+
+        StackEntry child = { node.offset[i], node.count[i], distances[i] };
+        int j = n++;
+        while (j > 0 && children[j - 1].distance < child.distance)
+        {
+          children[j] = children[j - 1];
+          j--;
+        }
+        children[j] = child;
+      }
+      stackSize += n;
+    }
+  }
+  template <typename IntersectLeaf>
+  void BoundingVolumeHierarchy::TraversePacket(const Ray* rays,
+    const int size, float* maxDistances, IntersectLeaf intersectLeaf) const
+  {
+    if (wideNodes.empty() || size == 0) return;
+
+    // Bound the origins and reciprocal directions of all rays. If the
+    // rays go in the same direction along every axis, the bounds can
+    // be used to skip nodes that all rays miss with a single test.
+    Vector3 invDirections[maxPacketSize];
+    Vector3 originMin = rays[0].origin, originMax = rays[0].origin;
+    invDirections[0] = GetInverseDirection(rays[0].direction);
+    Vector3 invDirectionMin = invDirections[0];
+    Vector3 invDirectionMax = invDirections[0];
+
+    for (int r = 1; r < size; r++)
+    {
+      invDirections[r] = GetInverseDirection(rays[r].direction);
+      originMin = Min(originMin, rays[r].origin);
+      originMax = Max(originMax, rays[r].origin);
+      invDirectionMin = Min(invDirectionMin, invDirections[r]);
+      invDirectionMax = Max(invDirectionMax, invDirections[r]);
+    }
+
+    const bool coherent =
+      invDirectionMin.x * invDirectionMax.x > 0.0f &&
+      invDirectionMin.y * invDirectionMax.y > 0.0f &&
+      invDirectionMin.z * invDirectionMax.z > 0.0f;
+
+    // The children that still have to be visited, with the rays that
+    // might hit them
+    struct StackEntry { int offset; int count; int rayMask; };
+    StackEntry fixedStack[fixedStackSize];
+    std::vector<StackEntry> heapStack;
+    StackEntry* stack = fixedStack;
+    int stackSize = 0;
+
+    // Every level adds at most all but one children of the node that
+    // was popped
+    if (width * depth > fixedStackSize)
+    {
+      heapStack.resize(width * depth);
+      stack = heapStack.data();
+    }
+
+    const StackEntry root = { 0, 0, (1 << size) - 1 };
+    stack[stackSize++] = root;
+
+    while (stackSize > 0)
+    {
+      const StackEntry entry = stack[--stackSize];
+
+      if (entry.count > 0)
+      {
+        intersectLeaf(entry.offset, entry.count, entry.rayMask);
+        continue;
+      }
+
+      const WideNode& node = wideNodes[entry.offset];
+
+      // First cull the children that no ray can hit at all
+      float packetMaxDistance = 0.0f;
+      for (int r = 0; r < size; r++)
+      {
+        if (entry.rayMask & (1 << r))
+          packetMaxDistance = std::fmax(packetMaxDistance, maxDistances[r]);
+      }
+
+      const int candidates = coherent
+        ? IntersectChildrenBounds(node, originMin, originMax,
+                                  invDirectionMin, invDirectionMax,
+                                  packetMaxDistance)
+        : (1 << width) - 1;
+      if (candidates == 0) continue;
+
+      // Then find out which rays hit which of the remaining children,
+      // and how near the nearest ray enters them
+      int rayMasks[width] = { 0 };
+      float nearest[width];
+      for (int i = 0; i < width; i++) nearest[i] = 1.0e30f;
+
+      for (int r = 0; r < size; r++)
+      {
+        if (!(entry.rayMask & (1 << r))) continue;
+
+        float distances[width];
+        int mask = candidates & IntersectChildren(node, rays[r].origin,
+          invDirections[r], maxDistances[r], distances);
+
+        for (; mask != 0; mask &= mask - 1)
+        {
+          int i = 0;
+          while (!(mask & (1 << i))) i++;
+          rayMasks[i] |= 1 << r;
+          nearest[i] = std::fmin(nearest[i], distances[i]);
+        }
+      }
+
+      // Push the children that are hit from far to near, as for a
+      // single ray
+      StackEntry* const children = stack + stackSize;
+      float childDistances[width];
+      int n = 0;
+      for (int i = 0; i < width; i++)
+      {
+        if (rayMasks[i] == 0) continue;
+
+        StackEntry child = { node.offset[i], node.count[i], rayMasks[i] };
+        int j = n++;
+        while (j > 0 && childDistances[j - 1] < nearest[i])
+        {
+          children[j] = children[j - 1];
+          childDistances[j] = childDistances[j - 1];
+          j--;
+        }
+        children[j] = child;
+        childDistances[j] = nearest[i];
+      }
+      stackSize += n;
+    }
+  }
+}
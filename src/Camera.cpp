@@ -25,13 +25,9 @@ using namespace Luculentus;
 
 Ray Camera::GetScreenRay(const float x, const float y,
                          const float chromaticAberrationFactor,
-                         const float dofAngle,
-                         const float dofRadius) const
+                         const Vector3 lensPoint) const
 {
-  // The smaller the FOV, the further the screen is away;
-  // the larger the FOV, the closer the screen is.
-  float screenDistance = 1.0f / std::tan(fieldOfView * 0.5f);
-  Vector3 direction = { x, screenDistance, -y };
+  Vector3 direction = { x, GetScreenDistance(), -y };
 
   // Then apply some wavelength dependent zoom to create chromatic
   // aberration. Please note, this is not a physically correct model of
@@ -45,16 +41,6 @@ Ray Camera::GetScreenRay(const float x, const float y,
   direction.Normalise();
   Vector3 focusPoint = direction * (focalDistance / direction.y);
 
-  // Then take a new point on the camera 'lens' (this is of course not
-  // accurate, but then again, the pinhole camera does not have depth of
-  // field at all, so it is a hack anyway).
-  Vector3 lensPoint =
-  {
-    std::cos(dofAngle) * dofRadius,
-    0.0f,
-    std::sin(dofAngle) * dofRadius
-  };
-  
   // Then construct the new ray,
   // from the lens point through the focus point.
   direction = focusPoint - lensPoint;
@@ -66,22 +52,87 @@ Ray Camera::GetScreenRay(const float x, const float y,
   return r;
 }
 
+float Camera::GetScreenDistance() const
+{
+  // The smaller the FOV, the further the screen is away;
+  // the larger the FOV, the closer the screen is.
+  return 1.0f / std::tan(fieldOfView * 0.5f);
+}
+
+float Camera::GetChromaticZoom(const float wavelength) const
+{
+  const float d = (wavelength - 580.0f) / 200.0f;
+  return 1.0f + d * chromaticAberration;
+}
+
 Ray Camera::GetRay(const float x, const float y, const float wavelength,
                    MonteCarloUnit& monteCarloUnit) const
 {
   // Pick depth of field coordinates randomly.
-  const float dofAngle = monteCarloUnit.GetLongitude();
-  const float dofRadius = monteCarloUnit.GetUnit() / depthOfField;
+  const Vector3 lensPoint = GetLensPoint(monteCarloUnit);
 
-  // Calculate a zoom factor based on the wavelenth
+  // Zoom based on the wavelength
   // to simulate chromatic aberration of the lens.
-  const float d = (wavelength - 580.0f) / 200.0f;
-  const float chromaticZoom = 1.0f + d * chromaticAberration;
+  const float chromaticZoom = GetChromaticZoom(wavelength);
 
-  Ray r = GetScreenRay(x, y, chromaticZoom, dofAngle, dofRadius);
+  Ray r = GetScreenRay(x, y, chromaticZoom, lensPoint);
   r.wavelength = wavelength;
 
   r.probability = 1.0f;
 
   return r;
 }
+
+Vector3 Camera::GetLensPoint(MonteCarloUnit& monteCarloUnit) const
+{
+  // Take a new point on the camera 'lens' (this is of course not
+  // accurate, but then again, the pinhole camera does not have depth of
+  // field at all, so it is a hack anyway).
+  const float dofAngle = monteCarloUnit.GetLongitude();
+  const float dofRadius = monteCarloUnit.GetUnit() / depthOfField;
+
+  const Vector3 lensPoint =
+  {
+    std::cos(dofAngle) * dofRadius,
+    0.0f,
+    std::sin(dofAngle) * dofRadius
+  };
+
+  return lensPoint;
+}
+
+bool Camera::Project(const Vector3 point, const Vector3 lensPoint,
+                     const float wavelength, float& x, float& y,
+                     float& screenDensity) const
+{
+  // Go back to the frame of the camera, in which the ray from the lens
+  // point must cross the focal plane where GetScreenRay puts the focus
+  // point
+  const Vector3 local = Rotate(point - position, Conjugate(orientation));
+  Vector3 direction = local - lensPoint;
+  if (direction.y <= 0.0f) return false;
+
+  const Vector3 focusPoint = lensPoint
+                           + direction * (focalDistance / direction.y);
+  const float scale = GetScreenDistance()
+                    / (focalDistance * GetChromaticZoom(wavelength));
+  x = focusPoint.x * scale;
+  y = -focusPoint.z * scale;
+
+  // The focal plane is parallel to the screen, so the screen area per
+  // unit solid angle grows with the inverse cube of the cosine of the
+  // angle with the optical axis
+  direction.Normalise();
+  screenDensity = scale * scale * focalDistance * focalDistance
+                / (direction.y * direction.y * direction.y);
+
+  return true;
+}
+
+float Camera::GetScreenDensity(const Ray ray) const
+{
+  const Vector3 axis = Rotate(MakeVector3(0.0f, 1.0f, 0.0f), orientation);
+  const float cosTheta = Dot(ray.direction, axis);
+  const float scale = GetScreenDistance() / GetChromaticZoom(ray.wavelength);
+  return scale * scale / (cosTheta * cosTheta * cosTheta);
+}
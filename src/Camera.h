@@ -55,13 +55,37 @@ namespace Luculentus
       Ray GetRay(const float x, const float y, const float wavelength,
                  MonteCarloUnit& monteCarloUnit) const;
 
+      /// Returns the factor by which the lens zooms in on light of the
+      /// specified wavelength, due to chromatic aberration.
+      float GetChromaticZoom(const float wavelength) const;
+
+      /// Picks a point on the lens, relative to the camera, the same way
+      /// that GetRay does.
+      Vector3 GetLensPoint(MonteCarloUnit& monteCarloUnit) const;
+
+      /// Finds the position on the screen of the ray through the lens
+      /// point (relative to the camera) that would hit the point in the
+      /// scene. Returns false if the point lies behind the lens.
+      /// Otherwise, the screen area that the ray covers per unit solid
+      /// angle is returned as well.
+      bool Project(const Vector3 point, const Vector3 lensPoint,
+                   const float wavelength, float& x, float& y,
+                   float& screenDensity) const;
+
+      /// Returns the screen area that the camera ray covers per unit
+      /// solid angle, for a ray of the specified wavelength.
+      float GetScreenDensity(const Ray ray) const;
+
+      /// Returns the distance of the screen from the lens, in screen
+      /// units.
+      float GetScreenDistance() const;
+
     private:
 
       /// Returns a ray through the screen,
       /// where -1.0 is left, 1.0 is right, and the units are square.
       Ray GetScreenRay(const float x, const float y,
                        const float chromaticAberrationFactor,
-                       const float dofAngle,
-                       const float dofRadius) const;
+                       const Vector3 lensPoint) const;
   };
 }
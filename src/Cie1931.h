@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "TristimulusTable.h"
 #include "Vector3.h"
 
 namespace Luculentus
@@ -37,8 +38,16 @@ namespace Luculentus
       /// starting at 380nm.
       static const float z[81];
 
+      /// The tristimulus values resampled for fast lookups.
+      static const TristimulusTable table;
+
     public:
     
       static Vector3 GetTristimulus(float wavelength);
+
+      /// Stores the tristimulus values of count wavelengths. This is
+      /// faster than converting them one at a time.
+      static void GetTristimuli(const float* wavelengths,
+                                Vector3* tristimuli, const int count);
   };
 }
@@ -16,42 +16,17 @@
 
 #include "Cie1964.h"
 
-#include <cmath>
-
 using namespace Luculentus;
 
 Vector3 Cie1964::GetTristimulus(float wavelength)
 {
-  float indexf    = (wavelength - 380.0f) / 5.0f;
-  short index     = static_cast<short>(std::floor(indexf));
-  float remainder = indexf - index;
-
-  if (index < -1 || index > 80) // Wavelength is not in visible spectrum.
-  {
-    return ZeroVector3();
-  }
-
-  if (index == -1) // No interpolation possible.
-  {
-    float cieX = x[0] * (remainder);
-    float cieY = y[0] * (remainder);
-    float cieZ = z[0] * (remainder);
-    return MakeVector3(cieX, cieY, cieZ);
-  }
-
-  if (index == 80) // No interpolation possible.
-  {
-    float cieX = x[80] * (1.0f - remainder);
-    float cieY = y[80] * (1.0f - remainder);
-    float cieZ = z[80] * (1.0f - remainder);
-    return MakeVector3(cieX, cieY, cieZ);
-  }
+  return table.GetTristimulus(wavelength);
+}
 
-  // Interpolate between two measurements.
-  float cieX = x[index] * (1.0f - remainder) + x[index + 1] * remainder;
-  float cieY = y[index] * (1.0f - remainder) + y[index + 1] * remainder;
-  float cieZ = z[index] * (1.0f - remainder) + z[index + 1] * remainder;
-  return MakeVector3(cieX, cieY, cieZ);
+void Cie1964::GetTristimuli(const float* wavelengths, Vector3* tristimuli,
+                            const int count)
+{
+  table.GetTristimuli(wavelengths, tristimuli, count);
 }
 
 // Data obtained from http://cvrl.ioo.ucl.ac.uk/index.htm
@@ -310,3 +285,5 @@ const float Cie1964::z[81] =
   0.000000f,
   0.000000f
 };
+
+const TristimulusTable Cie1964::table(x, y, z);
@@ -0,0 +1,841 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "CompiledScene.h"
+
+#include <algorithm>
+#include <typeinfo>
+#include "Constants.h"
+#include "MonteCarloUnit.h"
+
+using namespace Luculentus;
+
+// If the object is exactly of type T (not of a derived type, which might
+// behave differently), appends a copy to the table, and stores its index.
+template <typename T, typename Base>
+bool TryAppend(const Base& object, std::vector<T>& table, int& index)
+{
+  if (typeid(object) != typeid(T)) return false;
+
+  index = static_cast<int>(table.size());
+  table.push_back(static_cast<const T&>(object));
+  return true;
+}
+
+// If the surface is exactly of compound type T, appends its polyhedron
+// to the table, and stores its index.
+template <typename T>
+bool TryAppendPolyhedron(const Surface& surface,
+                         std::vector<ConvexPolyhedron>& table, int& index)
+{
+  if (typeid(surface) != typeid(T)) return false;
+
+  index = static_cast<int>(table.size());
+  table.push_back(static_cast<const T&>(surface).polyhedron);
+  return true;
+}
+
+CompiledScene::CompiledScene(const Scene& scene)
+  : GetCameraAtTime(scene.GetCameraAtTime)
+{
+  std::vector<BoundingBox> boxes;
+  std::vector<int> boundedPrimitives;
+  std::vector<LightTree::Light> lightBounds;
+
+  for (auto& object : scene.objects)
+  {
+    Primitive primitive = CompileSurface(*object.surface);
+    primitive.material = object.material
+      ? CompileMaterial(*object.material)
+      : CompileEmissiveMaterial(*object.emissiveMaterial);
+
+    // Sort the bounded and unbounded primitives, as the scene does
+    const int index = static_cast<int>(primitives.size());
+    BoundingBox box;
+    if (object.surface->GetBoundingBox(box))
+    {
+      boxes.push_back(box);
+      boundedPrimitives.push_back(index);
+    }
+    else
+    {
+      unboundedPrimitives.push_back(index);
+    }
+
+    if (IsLight(primitive))
+    {
+      // Spheres and circles are bounded
+      const LightTree::Light light = { box, GetPower(primitive) };
+      lightBounds.push_back(light);
+      lightIndices.push_back(static_cast<int>(lights.size()));
+      lights.push_back(index);
+    }
+    else lightIndices.push_back(-1);
+
+    primitives.push_back(primitive);
+  }
+
+  boundingVolumeHierarchy.Build(boxes);
+  lightTree.Build(lightBounds);
+
+  for (auto& primitive : boundingVolumeHierarchy.primitives)
+  {
+    primitive = boundedPrimitives[primitive];
+  }
+
+  spherePool.Clear();
+  for (int primitive : boundingVolumeHierarchy.primitives)
+  {
+    const Primitive p = primitives[primitive];
+    if (p.surfaceType == Primitive::SphereSurface)
+    {
+      const Sphere& sphere = spheres[p.surface];
+      spherePool.Add(sphere.position, sphere.radiusSquared);
+    }
+    else spherePool.AddEmpty();
+  }
+
+  spherePool.Finish();
+}
+
+CompiledScene::Primitive CompiledScene::CompileSurface(
+  const Surface& surface)
+{
+  Primitive p;
+  p.material = -1;
+
+  if (TryAppend(surface, planes, p.surface))
+    p.surfaceType = Primitive::PlaneSurface;
+  else if (TryAppend(surface, spacePartitionings, p.surface))
+    p.surfaceType = Primitive::SpacePartitioningSurface;
+  else if (TryAppend(surface, circles, p.surface))
+    p.surfaceType = Primitive::CircleSurface;
+  else if (TryAppend(surface, spheres, p.surface))
+    p.surfaceType = Primitive::SphereSurface;
+  else if (TryAppend(surface, paraboloids, p.surface))
+    p.surfaceType = Primitive::ParaboloidSurface;
+  else if (TryAppend(surface, cappedParaboloids, p.surface))
+    p.surfaceType = Primitive::CappedParaboloidSurface;
+  else if (TryAppend(surface, polyhedra, p.surface)
+        || TryAppendPolyhedron<ThickPlane>(surface, polyhedra, p.surface)
+        || TryAppendPolyhedron<InfinitePrism>(surface, polyhedra, p.surface)
+        || TryAppendPolyhedron<Prism>(surface, polyhedra, p.surface)
+        || TryAppendPolyhedron<HexagonalPrism>(surface, polyhedra, p.surface))
+    p.surfaceType = Primitive::PolyhedronSurface;
+  else
+  {
+    p.surfaceType = Primitive::GenericSurface;
+    p.surface = static_cast<int>(genericSurfaces.size());
+    genericSurfaces.push_back(&surface);
+  }
+
+  return p;
+}
+
+int CompiledScene::CompileMaterial(const Material& material)
+{
+  auto existing = materialIndices.find(&material);
+  if (existing != materialIndices.end()) return existing->second;
+
+  MaterialRecord r;
+  typedef MaterialRecord M;
+
+  if (TryAppend(material, clayMaterials, r.index))
+    r.type = M::ClayMaterialType;
+  else if (TryAppend(material, diffuseGreyMaterials, r.index))
+    r.type = M::DiffuseGreyMaterialType;
+  else if (TryAppend(material, diffuseColouredMaterials, r.index))
+    r.type = M::DiffuseColouredMaterialType;
+  else if (TryAppend(material, perfectMirrorMaterials, r.index))
+    r.type = M::PerfectMirrorMaterialType;
+  else if (TryAppend(material, glossyMirrorMaterials, r.index))
+    r.type = M::GlossyMirrorMaterialType;
+  else if (TryAppend(material, brushedMetalMaterials, r.index))
+    r.type = M::BrushedMetalMaterialType;
+  else if (TryAppend(material, bk7GlassMaterials, r.index))
+    r.type = M::Bk7GlassMaterialType;
+  else if (TryAppend(material, sf10GlassMaterials, r.index))
+    r.type = M::Sf10GlassMaterialType;
+  else if (TryAppend(material, soapBubbleMaterials, r.index))
+    r.type = M::SoapBubbleMaterialType;
+  else if (TryAppend(material, iridescentMaterials, r.index))
+    r.type = M::IridescentMaterialType;
+  else
+  {
+    r.type = M::GenericMaterialType;
+    r.index = static_cast<int>(genericMaterials.size());
+    genericMaterials.push_back(&material);
+  }
+
+  const int index = static_cast<int>(materials.size());
+  materials.push_back(r);
+  materialIndices[&material] = index;
+  return index;
+}
+
+int CompiledScene::CompileEmissiveMaterial(const EmissiveMaterial& material)
+{
+  auto existing = materialIndices.find(&material);
+  if (existing != materialIndices.end()) return existing->second;
+
+  MaterialRecord r;
+
+  if (TryAppend(material, blackBodyMaterials, r.index))
+    r.type = MaterialRecord::BlackBodyMaterialType;
+  else
+  {
+    r.type = MaterialRecord::GenericEmissiveMaterialType;
+    r.index = static_cast<int>(genericEmissiveMaterials.size());
+    genericEmissiveMaterials.push_back(&material);
+  }
+
+  const int index = static_cast<int>(materials.size());
+  materials.push_back(r);
+  materialIndices[&material] = index;
+  return index;
+}
+
+bool CompiledScene::IntersectDistance(const Primitive p, const Ray ray,
+                                      const float tMin, const float tMax,
+                                      float& distance, int& part) const
+{
+  // The qualified calls are not virtual, so they can be inlined
+  switch (p.surfaceType)
+  {
+    case Primitive::PlaneSurface:
+      return planes[p.surface].Plane::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    case Primitive::SpacePartitioningSurface:
+      return spacePartitionings[p.surface]
+        .SpacePartitioning::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    case Primitive::CircleSurface:
+      return circles[p.surface].Circle::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    case Primitive::SphereSurface:
+      return spheres[p.surface].Sphere::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    case Primitive::ParaboloidSurface:
+      return paraboloids[p.surface].Paraboloid::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    case Primitive::CappedParaboloidSurface:
+      return cappedParaboloids[p.surface]
+        .CappedParaboloid::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    case Primitive::PolyhedronSurface:
+      return polyhedra[p.surface].ConvexPolyhedron::IntersectDistance(
+        ray, tMin, tMax, distance, part);
+    default:
+      return genericSurfaces[p.surface]->IntersectDistance(
+        ray, tMin, tMax, distance, part);
+  }
+}
+
+void CompiledScene::GetAttributes(const Primitive p, const Ray ray,
+                                  const float distance, const int part,
+                                  Intersection& intersection) const
+{
+  switch (p.surfaceType)
+  {
+    case Primitive::PlaneSurface:
+      planes[p.surface].Plane::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    case Primitive::SpacePartitioningSurface:
+      spacePartitionings[p.surface].SpacePartitioning::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    case Primitive::CircleSurface:
+      circles[p.surface].Circle::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    case Primitive::SphereSurface:
+      spheres[p.surface].Sphere::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    case Primitive::ParaboloidSurface:
+      paraboloids[p.surface].Paraboloid::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    case Primitive::CappedParaboloidSurface:
+      cappedParaboloids[p.surface].CappedParaboloid::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    case Primitive::PolyhedronSurface:
+      polyhedra[p.surface].ConvexPolyhedron::GetAttributes(
+        ray, distance, part, intersection);
+      break;
+    default:
+      genericSurfaces[p.surface]->GetAttributes(
+        ray, distance, part, intersection);
+      break;
+  }
+}
+
+int CompiledScene::Intersect(const Ray ray, Intersection& intersection) const
+{
+  int primitive = -1;
+  int part = 0;
+
+  // Tests a primitive, and keeps it if it is the nearest so far
+  auto intersectPrimitive = [&](const int index, float& maxDistance)
+  {
+    float distance;
+    int currentPart;
+    if (IntersectDistance(primitives[index], ray, 0.0f, maxDistance,
+                          distance, currentPart))
+    {
+      maxDistance = distance;
+      part = currentPart;
+      primitive = index;
+    }
+  };
+
+  // Leaves test their spheres at once, and other primitives one by one
+  auto intersectLeaf = [&](const int offset, const int count,
+                           float& maxDistance)
+  {
+    int position;
+    if (spherePool.IntersectNearest(ray, offset, offset + count, 0.0f,
+                                    maxDistance, position))
+    {
+      part = 0;
+      primitive = boundingVolumeHierarchy.primitives[position];
+    }
+
+    for (int i = offset; i < offset + count; i++)
+    {
+      if (!spherePool.IsEmpty(i)) continue;
+      intersectPrimitive(boundingVolumeHierarchy.primitives[i], maxDistance);
+    }
+  };
+
+  float maxDistance = 1.0e12f;
+  for (int index : unboundedPrimitives) intersectPrimitive(index, maxDistance);
+  boundingVolumeHierarchy.Traverse(ray, maxDistance, intersectLeaf);
+
+  if (primitive != -1)
+  {
+    GetAttributes(primitives[primitive], ray, maxDistance, part,
+                  intersection);
+  }
+
+  return primitive;
+}
+
+void CompiledScene::IntersectPacket(const Ray* rays, const int size,
+                                    Intersection* intersections,
+                                    int* hitPrimitives) const
+{
+  float maxDistances[BoundingVolumeHierarchy::maxPacketSize];
+  int parts[BoundingVolumeHierarchy::maxPacketSize];
+
+  // Tests a primitive against one ray of the packet
+  auto intersectPrimitive = [&](const int index, const int r)
+  {
+    float distance;
+    int part;
+    if (IntersectDistance(primitives[index], rays[r], 0.0f,
+                          maxDistances[r], distance, part))
+    {
+      maxDistances[r] = distance;
+      parts[r] = part;
+      hitPrimitives[r] = index;
+    }
+  };
+
+  // Below the packet traversal, leaves are intersected ray by ray
+  auto intersectLeaf = [&](const int offset, const int count,
+                           const int rayMask)
+  {
+    for (int r = 0; r < size; r++)
+    {
+      if (!(rayMask & (1 << r))) continue;
+
+      int position;
+      if (spherePool.IntersectNearest(rays[r], offset, offset + count,
+                                      0.0f, maxDistances[r], position))
+      {
+        parts[r] = 0;
+        hitPrimitives[r] = boundingVolumeHierarchy.primitives[position];
+      }
+
+      for (int i = offset; i < offset + count; i++)
+      {
+        if (!spherePool.IsEmpty(i)) continue;
+        intersectPrimitive(boundingVolumeHierarchy.primitives[i], r);
+      }
+    }
+  };
+
+  for (int r = 0; r < size; r++)
+  {
+    maxDistances[r] = 1.0e12f;
+    hitPrimitives[r] = -1;
+    for (int index : unboundedPrimitives) intersectPrimitive(index, r);
+  }
+
+  boundingVolumeHierarchy.TraversePacket(rays, size, maxDistances,
+                                         intersectLeaf);
+
+  for (int r = 0; r < size; r++)
+  {
+    if (hitPrimitives[r] == -1) continue;
+    GetAttributes(primitives[hitPrimitives[r]], rays[r], maxDistances[r],
+                  parts[r], intersections[r]);
+  }
+}
+
+bool CompiledScene::IsOccluded(const Ray ray, const float distance) const
+{
+  bool occluded = false;
+
+  auto intersectPrimitive = [&](const int index, float& maxDistance)
+  {
+    float hitDistance;
+    int part;
+    if (IntersectDistance(primitives[index], ray, 0.0f, maxDistance,
+                          hitDistance, part))
+    {
+      occluded = true;
+      maxDistance = -1.0e30f;
+    }
+  };
+
+  auto intersectLeaf = [&](const int offset, const int count,
+                           float& maxDistance)
+  {
+    int position;
+    if (occluded) return;
+    if (spherePool.IntersectNearest(ray, offset, offset + count, 0.0f,
+                                    maxDistance, position))
+    {
+      occluded = true;
+      maxDistance = -1.0e30f;
+      return;
+    }
+
+    for (int i = offset; i < offset + count && !occluded; i++)
+    {
+      if (!spherePool.IsEmpty(i)) continue;
+      intersectPrimitive(boundingVolumeHierarchy.primitives[i], maxDistance);
+    }
+  };
+
+  float maxDistance = distance;
+  for (int index : unboundedPrimitives)
+  {
+    intersectPrimitive(index, maxDistance);
+    if (occluded) return true;
+  }
+
+  boundingVolumeHierarchy.Traverse(ray, maxDistance, intersectLeaf);
+
+  return occluded;
+}
+
+bool CompiledScene::IsLight(const Primitive primitive) const
+{
+  return materials[primitive.material].type
+         == MaterialRecord::BlackBodyMaterialType
+      && (primitive.surfaceType == Primitive::SphereSurface
+       || primitive.surfaceType == Primitive::CircleSurface);
+}
+
+float CompiledScene::GetPower(const Primitive light) const
+{
+  float intensity = 0.0f;
+  for (int i = 0; i < 40; i++)
+  {
+    intensity += GetIntensity(light.material, 385.0f + i * 10.0f);
+  }
+  intensity /= 40.0f;
+
+  // A circle emits on both sides
+  const float sides = light.surfaceType == Primitive::SphereSurface
+                    ? 1.0f : 2.0f;
+
+  return GetArea(light) * sides * intensity;
+}
+
+float CompiledScene::GetArea(const Primitive light) const
+{
+  return light.surfaceType == Primitive::SphereSurface
+    ? 4.0f * static_cast<float>(pi) * spheres[light.surface].radiusSquared
+    : static_cast<float>(pi) * circles[light.surface].radiusSquared;
+}
+
+// Returns one minus the cosine of the half angle of the cone that a
+// sphere with the squared radius at the squared distance subtends, or
+// zero if the point lies inside the sphere. This form does not lose
+// precision for small and distant spheres.
+float GetConeSize(const float radiusSquared, const float distanceSquared)
+{
+  if (distanceSquared <= radiusSquared) return 0.0f;
+  const float sinSquared = radiusSquared / distanceSquared;
+  return sinSquared / (1.0f + std::sqrt(1.0f - sinSquared));
+}
+
+bool CompiledScene::SampleLight(const Vector3 position,
+                                MonteCarloUnit& monteCarloUnit,
+                                LightSample& sample) const
+{
+  if (lightTree.IsEmpty()) return false;
+
+  float chance;
+  const int light = lightTree.Pick(position, monteCarloUnit.GetUnit(),
+                                   chance);
+  if (chance <= 0.0f) return false;
+
+  const Primitive p = primitives[lights[light]];
+  sample.material = p.material;
+
+  if (p.surfaceType == Primitive::SphereSurface)
+  {
+    // Pick a direction uniformly within the cone of the sphere
+    const Sphere& sphere = spheres[p.surface];
+    Vector3 toCentre = sphere.position - position;
+    const float distanceSquared = toCentre.MagnitudeSquared();
+    const float coneSize = GetConeSize(sphere.radiusSquared,
+                                       distanceSquared);
+    if (coneSize == 0.0f) return false;
+
+    const float phi = monteCarloUnit.GetLongitude();
+    const float cosTheta = 1.0f - monteCarloUnit.GetUnit() * coneSize;
+    const float sinTheta = std::sqrt(std::max(0.0f,
+                                     1.0f - cosTheta * cosTheta));
+    const Vector3 local =
+    {
+      std::cos(phi) * sinTheta,
+      std::sin(phi) * sinTheta,
+      cosTheta
+    };
+    toCentre.Normalise();
+    sample.direction = RotateTowards(local, toCentre);
+    sample.pdf = chance / (2.0f * static_cast<float>(pi) * coneSize);
+
+    // The direction hits the near side of the sphere
+    const float h = Dot(sample.direction, sphere.position - position);
+    const float perpendicular = distanceSquared - h * h;
+    sample.distance = h - std::sqrt(std::max(0.0f,
+                      sphere.radiusSquared - perpendicular));
+  }
+  else
+  {
+    // Pick a point uniformly on the area of the circle
+    const Circle& circle = circles[p.surface];
+    const float phi = monteCarloUnit.GetLongitude();
+    const float r = circle.radius * std::sqrt(monteCarloUnit.GetUnit());
+    const Vector3 local = { std::cos(phi) * r, std::sin(phi) * r, 0.0f };
+    const Vector3 point = circle.offset + RotateTowards(local, circle.normal);
+
+    Vector3 direction = point - position;
+    const float distanceSquared = direction.MagnitudeSquared();
+    sample.distance = std::sqrt(distanceSquared);
+    direction = direction * (1.0f / sample.distance);
+
+    // Convert the density per unit area into a density per unit solid
+    // angle; circles emit on both sides
+    const float cosLight = std::abs(Dot(direction, circle.normal));
+    if (cosLight < 1.0e-6f) return false;
+
+    sample.direction = direction;
+    sample.pdf = chance * distanceSquared
+               / (cosLight * static_cast<float>(pi) * circle.radiusSquared);
+  }
+
+  return true;
+}
+
+float CompiledScene::GetLightPdf(const int primitive, const Ray ray,
+                                 const Intersection intersection) const
+{
+  const Primitive p = primitives[primitive];
+  if (!IsLight(p)) return 0.0f;
+
+  const float chance = lightTree.GetChance(ray.origin,
+                                          lightIndices[primitive]);
+
+  if (p.surfaceType == Primitive::SphereSurface)
+  {
+    const Sphere& sphere = spheres[p.surface];
+    const float coneSize = GetConeSize(sphere.radiusSquared,
+      (sphere.position - ray.origin).MagnitudeSquared());
+    if (coneSize == 0.0f) return 0.0f;
+    return chance / (2.0f * static_cast<float>(pi) * coneSize);
+  }
+  else
+  {
+    const Circle& circle = circles[p.surface];
+    const float cosLight = std::abs(Dot(ray.direction, circle.normal));
+    if (cosLight < 1.0e-6f) return 0.0f;
+    return chance * intersection.distance * intersection.distance
+         / (cosLight * static_cast<float>(pi) * circle.radiusSquared);
+  }
+}
+
+bool CompiledScene::SampleEmission(MonteCarloUnit& monteCarloUnit,
+                                   Emission& emission) const
+{
+  if (lightTree.IsEmpty()) return false;
+
+  float chance;
+  const int light = lightTree.PickByPower(monteCarloUnit.GetUnit(), chance);
+  const Primitive p = primitives[lights[light]];
+  emission.primitive = lights[light];
+  emission.material = p.material;
+  emission.areaPdf = chance / GetArea(p);
+
+  // Pick a point uniformly on the area, and the side of a circle
+  const float phi = monteCarloUnit.GetLongitude();
+  const float u = monteCarloUnit.GetUnit();
+  Vector3 facing;
+  if (p.surfaceType == Primitive::SphereSurface)
+  {
+    const Sphere& sphere = spheres[p.surface];
+    const float z = 1.0f - 2.0f * u;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    emission.normal = MakeVector3(std::cos(phi) * r, std::sin(phi) * r, z);
+    emission.position = sphere.position
+                      + emission.normal * std::sqrt(sphere.radiusSquared);
+    facing = emission.normal;
+  }
+  else
+  {
+    const Circle& circle = circles[p.surface];
+    const float r = circle.radius * std::sqrt(u);
+    const Vector3 local = { std::cos(phi) * r, std::sin(phi) * r, 0.0f };
+    emission.position = circle.offset + RotateTowards(local, circle.normal);
+    emission.normal = circle.normal;
+    facing = monteCarloUnit.GetUnit() < 0.5f ? circle.normal : -circle.normal;
+  }
+
+  // Light leaves a black body equally in all directions, so the number
+  // of photons in a direction is proportional to the cosine
+  const Vector3 local = monteCarloUnit.GetCosineDistributedHemisphereVector();
+  emission.direction = RotateTowards(local, facing);
+  emission.directionPdf = GetEmissionDirectionPdf(emission.primitive,
+                                                  emission.normal,
+                                                  emission.direction);
+
+  return emission.directionPdf > 0.0f;
+}
+
+float CompiledScene::GetEmissionPdf(const int primitive) const
+{
+  const int light = lightIndices[primitive];
+  if (light == -1) return 0.0f;
+
+  const Primitive p = primitives[primitive];
+  return lightTree.GetPowerChance(light) / GetArea(p);
+}
+
+float CompiledScene::GetEmissionDirectionPdf(const int primitive,
+                                             const Vector3 normal,
+                                             const Vector3 direction) const
+{
+  const float cosTheta = Dot(normal, direction);
+
+  // A circle picks either side with equal chance
+  if (primitives[primitive].surfaceType == Primitive::CircleSurface)
+    return std::abs(cosTheta) * 0.5f / static_cast<float>(pi);
+
+  return std::max(0.0f, cosTheta) / static_cast<float>(pi);
+}
+
+float CompiledScene::GetReflectance(const int material,
+                                    const float wavelength) const
+{
+  const MaterialRecord r = materials[material];
+
+  switch (r.type)
+  {
+    case MaterialRecord::ClayMaterialType:
+      return clayMaterials[r.index]
+        .ClayMaterial::GetReflectance(wavelength);
+    case MaterialRecord::DiffuseGreyMaterialType:
+      return diffuseGreyMaterials[r.index]
+        .DiffuseGreyMaterial::GetReflectance(wavelength);
+    default:
+      return diffuseColouredMaterials[r.index]
+        .DiffuseColouredMaterial::GetReflectance(wavelength);
+  }
+}
+
+Spectrum CompiledScene::GetReflectances(const int material,
+                                        const Spectrum wavelengths) const
+{
+  Spectrum reflectances;
+  for (int i = 0; i < Spectrum::size; i++)
+    reflectances[i] = GetReflectance(material, wavelengths[i]);
+  return reflectances;
+}
+
+Ray CompiledScene::GetNewRay(const int material, const Ray incomingRay,
+                             const Intersection intersection,
+                             MonteCarloUnit& monteCarloUnit) const
+{
+  const MaterialRecord r = materials[material];
+  const Ray ray = incomingRay;
+  const Intersection& i = intersection;
+  MonteCarloUnit& mc = monteCarloUnit;
+
+  switch (r.type)
+  {
+    case MaterialRecord::ClayMaterialType:
+      return clayMaterials[r.index]
+        .ClayMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::DiffuseGreyMaterialType:
+      return diffuseGreyMaterials[r.index]
+        .DiffuseGreyMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::DiffuseColouredMaterialType:
+      return diffuseColouredMaterials[r.index]
+        .DiffuseColouredMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::PerfectMirrorMaterialType:
+      return perfectMirrorMaterials[r.index]
+        .PerfectMirrorMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::GlossyMirrorMaterialType:
+      return glossyMirrorMaterials[r.index]
+        .GlossyMirrorMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::BrushedMetalMaterialType:
+      return brushedMetalMaterials[r.index]
+        .BrushedMetalMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::Bk7GlassMaterialType:
+      return bk7GlassMaterials[r.index]
+        .Bk7GlassMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::Sf10GlassMaterialType:
+      return sf10GlassMaterials[r.index]
+        .Sf10GlassMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::SoapBubbleMaterialType:
+      return soapBubbleMaterials[r.index]
+        .SoapBubbleMaterial::GetNewRay(ray, i, mc);
+    case MaterialRecord::IridescentMaterialType:
+      return iridescentMaterials[r.index]
+        .IridescentMaterial::GetNewRay(ray, i, mc);
+    default:
+      return genericMaterials[r.index]->GetNewRay(ray, i, mc);
+  }
+}
+
+bool CompiledScene::IsDispersive(const int material) const
+{
+  const MaterialRecord r = materials[material];
+
+  switch (r.type)
+  {
+    case MaterialRecord::Bk7GlassMaterialType:
+    case MaterialRecord::Sf10GlassMaterialType:
+      return true;
+    case MaterialRecord::GenericMaterialType:
+      return genericMaterials[r.index]->IsDispersive();
+    default:
+      return false;
+  }
+}
+
+// Returns the probability of the bounce with material m at every
+// wavelength, calling the implementation of type T directly.
+template <typename T>
+Spectrum GetProbabilitiesOf(const T& m, const Ray incomingRay,
+                            const Intersection& intersection,
+                            const Ray newRay, const Spectrum wavelengths)
+{
+  Spectrum probabilities;
+  for (int i = 0; i < Spectrum::size; i++)
+  {
+    probabilities[i] = m.T::GetProbability(incomingRay, intersection,
+                                           newRay, wavelengths[i]);
+  }
+  return probabilities;
+}
+
+Spectrum CompiledScene::GetProbabilities(const int material,
+                                         const Ray incomingRay,
+                                         const Intersection intersection,
+                                         const Ray newRay,
+                                         const Spectrum wavelengths) const
+{
+  const MaterialRecord r = materials[material];
+  const Ray ray = incomingRay;
+  const Intersection& i = intersection;
+  const Spectrum& w = wavelengths;
+
+  switch (r.type)
+  {
+    case MaterialRecord::ClayMaterialType:
+      return GetProbabilitiesOf(clayMaterials[r.index], ray, i, newRay, w);
+    case MaterialRecord::DiffuseGreyMaterialType:
+      return GetProbabilitiesOf(diffuseGreyMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::DiffuseColouredMaterialType:
+      return GetProbabilitiesOf(diffuseColouredMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::PerfectMirrorMaterialType:
+      return GetProbabilitiesOf(perfectMirrorMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::GlossyMirrorMaterialType:
+      return GetProbabilitiesOf(glossyMirrorMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::BrushedMetalMaterialType:
+      return GetProbabilitiesOf(brushedMetalMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::Bk7GlassMaterialType:
+      return GetProbabilitiesOf(bk7GlassMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::Sf10GlassMaterialType:
+      return GetProbabilitiesOf(sf10GlassMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::SoapBubbleMaterialType:
+      return GetProbabilitiesOf(soapBubbleMaterials[r.index],
+                                ray, i, newRay, w);
+    case MaterialRecord::IridescentMaterialType:
+      return GetProbabilitiesOf(iridescentMaterials[r.index],
+                                ray, i, newRay, w);
+    default:
+    {
+      Spectrum probabilities;
+      for (int j = 0; j < Spectrum::size; j++)
+      {
+        probabilities[j] = genericMaterials[r.index]
+          ->GetProbability(ray, i, newRay, w[j]);
+      }
+      return probabilities;
+    }
+  }
+}
+
+float CompiledScene::GetIntensity(const int material,
+                                  const float wavelength) const
+{
+  const MaterialRecord r = materials[material];
+
+  if (r.type == MaterialRecord::BlackBodyMaterialType)
+  {
+    return blackBodyMaterials[r.index]
+      .BlackBodyMaterial::GetIntensity(wavelength);
+  }
+
+  return genericEmissiveMaterials[r.index]->GetIntensity(wavelength);
+}
+
+Spectrum CompiledScene::GetIntensities(const int material,
+                                       const Spectrum wavelengths) const
+{
+  Spectrum intensities;
+  for (int i = 0; i < Spectrum::size; i++)
+    intensities[i] = GetIntensity(material, wavelengths[i]);
+  return intensities;
+}
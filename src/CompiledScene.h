@@ -0,0 +1,345 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <vector>
+#include "BoundingVolumeHierarchy.h"
+#include "Camera.h"
+#include "Compound.h"
+#include "EmissiveMaterial.h"
+#include "LightTree.h"
+#include "Material.h"
+#include "Scene.h"
+#include "Spectrum.h"
+#include "SpherePool.h"
+#include "Surface.h"
+
+namespace Luculentus
+{
+  /// An immutable version of a scene, prepared for rendering. Surfaces
+  /// and materials are stored by value in a table per type, and refer
+  /// to each other by index, so rendering does not have to follow
+  /// pointers all over the heap, and can call the implementation for a
+  /// type directly instead of through a virtual function. Types that
+  /// have no table are still called through their base class. Those are
+  /// referenced, not copied, so the scene must outlive the compiled
+  /// scene.
+  class CompiledScene
+  {
+    public:
+
+      struct Primitive
+      {
+        enum SurfaceType
+        {
+          PlaneSurface,
+          SpacePartitioningSurface,
+          CircleSurface,
+          SphereSurface,
+          ParaboloidSurface,
+          CappedParaboloidSurface,
+          /// A compound of space partitionings only.
+          PolyhedronSurface,
+          /// Any other surface, called through Surface.
+          GenericSurface
+        }
+        /// The table in which the surface is stored.
+        surfaceType;
+
+        /// The index of the surface in its table.
+        int surface;
+
+        /// The index of the material in the materials table.
+        int material;
+      };
+
+      struct MaterialRecord
+      {
+        enum MaterialType
+        {
+          ClayMaterialType,
+          DiffuseGreyMaterialType,
+          DiffuseColouredMaterialType,
+          PerfectMirrorMaterialType,
+          GlossyMirrorMaterialType,
+          BrushedMetalMaterialType,
+          Bk7GlassMaterialType,
+          Sf10GlassMaterialType,
+          SoapBubbleMaterialType,
+          IridescentMaterialType,
+          /// Any other material, called through Material.
+          GenericMaterialType,
+          BlackBodyMaterialType,
+          /// Any other emissive material, called through
+          /// EmissiveMaterial.
+          GenericEmissiveMaterialType
+        }
+        /// The table in which the material is stored.
+        type;
+
+        /// The index of the material in its table.
+        int index;
+      };
+
+      /// A point on a light, sampled from a point in the scene.
+      struct LightSample
+      {
+        /// The direction from the point towards the light.
+        Vector3 direction;
+
+        /// The distance to the light along the direction.
+        float distance;
+
+        /// The probability density of the direction per unit solid
+        /// angle, including the chance of picking this light, see
+        /// LightTree.
+        float pdf;
+
+        /// The emissive material of the light.
+        int material;
+      };
+
+      /// A point on a light and a direction from which a light path
+      /// starts.
+      struct Emission
+      {
+        /// The point on the light.
+        Vector3 position;
+
+        /// The normal of the light at the point, pointing outward for a
+        /// sphere.
+        Vector3 normal;
+
+        /// The direction in which the light leaves.
+        Vector3 direction;
+
+        /// The probability density of the point per unit area,
+        /// including the chance of picking this light.
+        float areaPdf;
+
+        /// The probability density of the direction per unit solid
+        /// angle.
+        float directionPdf;
+
+        /// The primitive of the light.
+        int primitive;
+
+        /// The emissive material of the light.
+        int material;
+      };
+
+      /// A function that returns the camera at the specified time, the
+      /// same as for the scene.
+      std::function<Camera (const float)> GetCameraAtTime;
+
+      /// All objects of the scene, in the same order.
+      std::vector<Primitive> primitives;
+
+      /// The materials of the primitives. Objects that share a material
+      /// share the record.
+      std::vector<MaterialRecord> materials;
+
+      /// The primitives that can be sampled directly: black bodies that
+      /// are spheres or circles.
+      std::vector<int> lights;
+
+      /// Compiles the scene. Only the generic surfaces and materials
+      /// still refer to the scene.
+      CompiledScene(const Scene& scene);
+
+      /// Intersects the specified ray with the scene. If a primitive is
+      /// intersected, its index is returned, and the intersection is
+      /// set. Otherwise, -1 is returned.
+      int Intersect(const Ray ray, Intersection& intersection) const;
+
+      /// Intersects a packet of at most
+      /// BoundingVolumeHierarchy::maxPacketSize coherent rays with the
+      /// scene, as Intersect does for every ray. The packet is traversed
+      /// through the hierarchy at once.
+      void IntersectPacket(const Ray* rays, const int size,
+                           Intersection* intersections,
+                           int* hitPrimitives) const;
+
+      /// Returns whether anything lies on the ray before the specified
+      /// distance.
+      bool IsOccluded(const Ray ray, const float distance) const;
+
+      /// Returns whether the material emits light, rather than
+      /// scattering it.
+      inline bool IsEmissive(const int material) const
+      {
+        return materials[material].type
+            >= MaterialRecord::BlackBodyMaterialType;
+      }
+
+      /// Returns whether the material is perfectly diffuse, so that the
+      /// light it reflects can be sampled directly.
+      inline bool IsDiffuse(const int material) const
+      {
+        return materials[material].type
+            <= MaterialRecord::DiffuseColouredMaterialType;
+      }
+
+      /// Returns the reflectance of a diffuse material, see
+      /// ClayMaterial::GetReflectance.
+      float GetReflectance(const int material, const float wavelength) const;
+
+      /// Returns the reflectance of a diffuse material at every
+      /// wavelength.
+      Spectrum GetReflectances(const int material,
+                               const Spectrum wavelengths) const;
+
+      /// Picks a light and a direction towards it, as seen from the
+      /// position. Returns false if there is no light that can be seen.
+      bool SampleLight(const Vector3 position,
+                       MonteCarloUnit& monteCarloUnit,
+                       LightSample& sample) const;
+
+      /// Returns the probability density with which SampleLight would
+      /// have picked the direction of the ray, that started at its
+      /// origin and hit the primitive at the intersection. Primitives
+      /// that are not lights are never picked.
+      float GetLightPdf(const int primitive, const Ray ray,
+                        const Intersection intersection) const;
+
+      /// Picks a light by power, a point on it, and a direction in which
+      /// light leaves from there. Returns false if there are no lights.
+      bool SampleEmission(MonteCarloUnit& monteCarloUnit,
+                          Emission& emission) const;
+
+      /// Returns the probability density per unit area with which
+      /// SampleEmission picks a point on the primitive, or zero if it is
+      /// not a light.
+      float GetEmissionPdf(const int primitive) const;
+
+      /// Returns the probability density per unit solid angle with which
+      /// SampleEmission picks the direction from a point with the normal
+      /// on the light.
+      float GetEmissionDirectionPdf(const int primitive,
+                                    const Vector3 normal,
+                                    const Vector3 direction) const;
+
+      /// Returns the ray that continues the light path, see
+      /// Material::GetNewRay. The material must not be emissive.
+      Ray GetNewRay(const int material, const Ray incomingRay,
+                    const Intersection intersection,
+                    MonteCarloUnit& monteCarloUnit) const;
+
+      /// Returns whether the direction of new rays depends on the
+      /// wavelength, see Material::IsDispersive.
+      bool IsDispersive(const int material) const;
+
+      /// Returns the probability of the bounce from the incoming ray to
+      /// the new ray at every wavelength, see Material::GetProbability.
+      /// The material must not be emissive.
+      Spectrum GetProbabilities(const int material, const Ray incomingRay,
+                                const Intersection intersection,
+                                const Ray newRay,
+                                const Spectrum wavelengths) const;
+
+      /// Returns the intensity of an emissive material at the specified
+      /// wavelength, see EmissiveMaterial::GetIntensity.
+      float GetIntensity(const int material, const float wavelength) const;
+
+      /// Returns the intensity of an emissive material at every
+      /// wavelength.
+      Spectrum GetIntensities(const int material,
+                              const Spectrum wavelengths) const;
+
+    private:
+
+      // Surface tables
+      std::vector<Plane> planes;
+      std::vector<SpacePartitioning> spacePartitionings;
+      std::vector<Circle> circles;
+      std::vector<Sphere> spheres;
+      std::vector<Paraboloid> paraboloids;
+      std::vector<CappedParaboloid> cappedParaboloids;
+      std::vector<ConvexPolyhedron> polyhedra;
+      std::vector<const Surface*> genericSurfaces;
+
+      // Material tables
+      std::vector<ClayMaterial> clayMaterials;
+      std::vector<DiffuseGreyMaterial> diffuseGreyMaterials;
+      std::vector<DiffuseColouredMaterial> diffuseColouredMaterials;
+      std::vector<PerfectMirrorMaterial> perfectMirrorMaterials;
+      std::vector<GlossyMirrorMaterial> glossyMirrorMaterials;
+      std::vector<BrushedMetalMaterial> brushedMetalMaterials;
+      std::vector<Bk7GlassMaterial> bk7GlassMaterials;
+      std::vector<Sf10GlassMaterial> sf10GlassMaterials;
+      std::vector<SoapBubbleMaterial> soapBubbleMaterials;
+      std::vector<IridescentMaterial> iridescentMaterials;
+      std::vector<const Material*> genericMaterials;
+      std::vector<BlackBodyMaterial> blackBodyMaterials;
+      std::vector<const EmissiveMaterial*> genericEmissiveMaterials;
+
+      /// The hierarchy over all bounded primitives.
+      BoundingVolumeHierarchy boundingVolumeHierarchy;
+
+      /// The spheres in the hierarchy, at the same positions as in the
+      /// primitives array of the hierarchy, other primitives have an
+      /// empty slot.
+      SpherePool spherePool;
+
+      /// The indices of the primitives that have no bounding box.
+      std::vector<int> unboundedPrimitives;
+
+      /// Picks one of the lights to sample.
+      LightTree lightTree;
+
+      /// For every primitive, its index in the lights array, or -1 if it
+      /// is not a light.
+      std::vector<int> lightIndices;
+
+      /// The records of the materials compiled so far, by address.
+      std::map<const void*, int> materialIndices;
+
+      /// Adds the surface to its table, and returns the primitive that
+      /// refers to it (without material).
+      Primitive CompileSurface(const Surface& surface);
+
+      /// Adds the material to its table if it was not compiled before,
+      /// and returns the index of its record.
+      int CompileMaterial(const Material& material);
+
+      /// Adds the emissive material to its table if it was not compiled
+      /// before, and returns the index of its record.
+      int CompileEmissiveMaterial(const EmissiveMaterial& material);
+
+      /// Returns whether the primitive is a light that can be sampled.
+      bool IsLight(const Primitive primitive) const;
+
+      /// Returns an estimate of the power that the light emits, its area
+      /// times its average intensity over the visible spectrum.
+      float GetPower(const Primitive light) const;
+
+      /// Returns the area of a light that can be sampled.
+      float GetArea(const Primitive light) const;
+
+      /// See Surface::IntersectDistance.
+      bool IntersectDistance(const Primitive primitive, const Ray ray,
+                             const float tMin, const float tMax,
+                             float& distance, int& part) const;
+
+      /// See Surface::GetAttributes.
+      void GetAttributes(const Primitive primitive, const Ray ray,
+                         const float distance, const int part,
+                         Intersection& intersection) const;
+  };
+}
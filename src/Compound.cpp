@@ -20,6 +20,132 @@
 
 using namespace Luculentus;
 
+void ConvexPolyhedron::AddPlane(const Vector3 normal, const Vector3 offset)
+{
+  normals.push_back(normal);
+  distances.push_back(Dot(normal, offset));
+}
+
+bool ConvexPolyhedron::IntersectDistance(const Ray ray,
+                                         const float tMin,
+                                         const float tMax,
+                                         float& distance,
+                                         int& part) const
+{
+  // Clip the ray against every plane. Where the ray moves towards the
+  // inside of a plane it enters the half-space, otherwise it leaves it.
+  // The ray is inside the polyhedron between the last entry and the
+  // first exit.
+  float tEnter = -1.0e30f, tLeave = 1.0e30f;
+  int enterPlane = -1, leavePlane = -1;
+
+  for (size_t i = 0; i < normals.size(); i++)
+  {
+    const float nDotD = Dot(normals[i], ray.direction);
+    const float height = Dot(normals[i], ray.origin) - distances[i];
+
+    // A ray parallel to the plane is either inside or outside forever
+    if (nDotD == 0.0f)
+    {
+      if (height > 0.0f) return false;
+      continue;
+    }
+
+    const float t = -height / nDotD;
+    if (nDotD < 0.0f)
+    {
+      if (t > tEnter) { tEnter = t; enterPlane = static_cast<int>(i); }
+    }
+    else
+    {
+      if (t < tLeave) { tLeave = t; leavePlane = static_cast<int>(i); }
+    }
+
+    // If the ray leaves before it has entered, it misses, and if it
+    // leaves before the range of interest or enters after it, the
+    // polyhedron is not interesting either
+    if (tEnter > tLeave || tLeave <= tMin || tEnter >= tMax) return false;
+  }
+
+  // A ray from outside hits where it enters, a ray from inside (after
+  // refraction) hits where it leaves. A ray has one direction only, do
+  // not hit backwards. The part is the plane that was hit.
+  if (tEnter > tMin) { distance = tEnter; part = enterPlane; }
+  else if (tLeave < tMax && leavePlane != -1)
+  {
+    distance = tLeave; part = leavePlane;
+  }
+  else return false;
+
+  return true;
+}
+
+void ConvexPolyhedron::GetAttributes(const Ray ray, const float distance,
+                                     const int part,
+                                     Intersection& intersection) const
+{
+  intersection.distance = distance;
+  intersection.position = ray.origin + distance * ray.direction;
+  intersection.normal = normals[part]; // The normal always points outward
+}
+
+bool ConvexPolyhedron::LiesInside(const Vector3 x) const
+{
+  for (size_t i = 0; i < normals.size(); i++)
+  {
+    if (Dot(normals[i], x) >= distances[i]) return false;
+  }
+
+  return true;
+}
+
+bool ConvexPolyhedron::GetBoundingBox(BoundingBox& box) const
+{
+  // Clip the polyhedron by a huge box, so that it has corners even if
+  // it is unbounded. Every corner lies on three planes, so try every
+  // combination of three planes, and keep the points that lie inside.
+  const float huge = 1.0e5f;
+  std::vector<Vector3> n(normals);
+  std::vector<float> d(distances);
+  n.push_back(MakeVector3( 1.0f, 0.0f, 0.0f)); d.push_back(huge);
+  n.push_back(MakeVector3(-1.0f, 0.0f, 0.0f)); d.push_back(huge);
+  n.push_back(MakeVector3(0.0f,  1.0f, 0.0f)); d.push_back(huge);
+  n.push_back(MakeVector3(0.0f, -1.0f, 0.0f)); d.push_back(huge);
+  n.push_back(MakeVector3(0.0f, 0.0f,  1.0f)); d.push_back(huge);
+  n.push_back(MakeVector3(0.0f, 0.0f, -1.0f)); d.push_back(huge);
+
+  box = EmptyBoundingBox();
+  bool hasCorners = false;
+
+  for (size_t i = 0; i < n.size(); i++)
+  for (size_t j = i + 1; j < n.size(); j++)
+  for (size_t k = j + 1; k < n.size(); k++)
+  {
+    // Solve for the point on all three planes with Cramer's rule
+    const Vector3 jk = Cross(n[j], n[k]);
+    const float det = Dot(n[i], jk);
+    if (std::abs(det) < 1.0e-6f) continue;
+
+    const Vector3 corner = (jk * d[i] + Cross(n[k], n[i]) * d[j]
+                         + Cross(n[i], n[j]) * d[k]) * (1.0f / det);
+
+    bool inside = true;
+    for (size_t m = 0; m < n.size() && inside; m++)
+    {
+      inside = Dot(n[m], corner) - d[m] < 1.0e-3f * (1.0f + std::abs(d[m]));
+    }
+    if (!inside) continue;
+
+    // A corner on the huge box means the polyhedron extends to infinity
+    if (k >= normals.size()) return false;
+
+    box = Union(box, BoundingBox { corner, corner });
+    hasCorners = true;
+  }
+
+  return hasCorners;
+}
+
 ConvexLens Luculentus::MakeConvexLens(const Vector3 position,
                                       const Vector3 axis,
                                       const float thickness,
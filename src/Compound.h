@@ -16,11 +16,59 @@
 
 #pragma once
 
+#include <type_traits>
+#include <vector>
 #include "Surface.h"
 #include "Volume.h"
 
 namespace Luculentus
 {
+  /// A convex volume bounded by planes only: the intersection of a
+  /// number of space partitionings.
+  class ConvexPolyhedron : public Surface, public Volume
+  {
+    public:
+
+      /// The outward pointing normals of the bounding planes.
+      std::vector<Vector3> normals;
+
+      /// For every plane, the dot product of its normal with a point in
+      /// the plane.
+      std::vector<float> distances;
+
+      /// Adds a bounding plane with the specified outward normal,
+      /// through the specified point.
+      void AddPlane(const Vector3 normal, const Vector3 offset);
+
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const;
+
+      virtual bool LiesInside(const Vector3 x) const;
+
+      virtual bool GetBoundingBox(BoundingBox& box) const;
+  };
+
+  template <typename T1, typename T2>
+  class IntersectionCompound;
+
+  /// Whether a surface is an intersection of space partitionings only,
+  /// which makes it a convex polyhedron.
+  template <typename T>
+  struct IsConvexPolyhedron : std::false_type { };
+
+  template <>
+  struct IsConvexPolyhedron<SpacePartitioning> : std::true_type { };
+
+  template <typename T1, typename T2>
+  struct IsConvexPolyhedron<IntersectionCompound<T1, T2>>
+    : std::integral_constant<bool, IsConvexPolyhedron<T1>::value
+                                && IsConvexPolyhedron<T2>::value> { };
+
   template <typename T1, typename T2>
   class IntersectionCompound : public Surface, public Volume
   {
@@ -32,30 +80,87 @@ namespace Luculentus
       /// The second of the two surfaces.
       T2 surface2;
 
+      /// If both surfaces consist of space partitionings only, the
+      /// same volume as a polyhedron, which can be intersected in a
+      /// single pass. Empty otherwise.
+      ConvexPolyhedron polyhedron;
+
       /// Creates a new object,
       /// which is the intersection of the two specified objects.
       IntersectionCompound(const T1& s1, const T2& s2)
         : surface1(s1)
         , surface2(s2)
       {
-
+        BuildPolyhedron(IsConvexPolyhedron<IntersectionCompound>());
       }
 
       IntersectionCompound(const IntersectionCompound<T1, T2>& other)
         : surface1(other.surface1)
         , surface2(other.surface2)
+        , polyhedron(other.polyhedron)
+      {
+
+      }
+
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const
+      {
+        return IntersectDistance(ray, tMin, tMax, distance, part,
+                                 IsConvexPolyhedron<IntersectionCompound>());
+      }
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const
+      {
+        GetAttributes(ray, distance, part, intersection,
+                      IsConvexPolyhedron<IntersectionCompound>());
+      }
+
+      virtual bool LiesInside(const Vector3 x) const
+      {
+        // The point must lie in both volumes to lie in its intersection.
+        return surface1.LiesInside(x) && surface2.LiesInside(x);
+      }
+
+      virtual bool GetBoundingBox(BoundingBox& box) const
+      {
+        return GetBoundingBox(box,
+                              IsConvexPolyhedron<IntersectionCompound>());
+      }
+
+    private:
+
+      void BuildPolyhedron(std::true_type)
       {
+        AddPlanes(surface1, polyhedron);
+        AddPlanes(surface2, polyhedron);
+      }
+
+      void BuildPolyhedron(std::false_type) { }
 
+      bool IntersectDistance(const Ray ray,
+                             const float tMin, const float tMax,
+                             float& distance, int& part,
+                             std::true_type) const
+      {
+        return polyhedron.IntersectDistance(ray, tMin, tMax, distance, part);
       }
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const
+      bool IntersectDistance(const Ray ray,
+                             const float tMin, const float tMax,
+                             float& distance, int& part,
+                             std::false_type) const
       {
         // Intersect both surfaces.
-        Intersection i1, i2;
+        float d1, d2;
+        int part1, part2;
 
-        bool surface1Intersected = surface1.Intersect(ray, i1);
-        bool surface2Intersected = surface2.Intersect(ray, i2);
+        bool surface1Intersected = surface1.IntersectDistance(ray,
+                                     tMin, tMax, d1, part1);
+        bool surface2Intersected = surface2.IntersectDistance(ray,
+                                     tMin, tMax, d2, part2);
 
         // If not intersecting any of the two,
         // it is not intersecting the compound object either.
@@ -63,9 +168,11 @@ namespace Luculentus
 
         // Invalidate intersections that do not lie inside
         // the intersection of the two volumes.
-        if (surface1Intersected && !surface2.LiesInside(i1.position))
+        if (surface1Intersected
+            && !surface2.LiesInside(ray.origin + d1 * ray.direction))
           surface1Intersected = false;
-        if (surface2Intersected && !surface1.LiesInside(i2.position))
+        if (surface2Intersected
+            && !surface1.LiesInside(ray.origin + d2 * ray.direction))
           surface2Intersected = false;
 
         // Again, if both intersections are now invalid,
@@ -75,23 +182,74 @@ namespace Luculentus
         // If both intersections are valid, pick the closest one.
         if (surface1Intersected && surface2Intersected)
         {
-          if (i1.distance < i2.distance)surface2Intersected = false;
+          if (d1 < d2)surface2Intersected = false;
           else surface1Intersected = false;
         }
 
-        // Now pick the best intersection.
-        if (surface1Intersected) intersection = i1;
-        else intersection = i2;
+        // Now pick the best intersection. The lowest bit of the part
+        // tells which surface was hit, the other bits are its own part.
+        if (surface1Intersected) { distance = d1; part = part1 * 2; }
+        else { distance = d2; part = part2 * 2 + 1; }
         return true;
       }
 
-      virtual bool LiesInside(const Vector3 x) const
+      void GetAttributes(const Ray ray, const float distance,
+                         const int part, Intersection& intersection,
+                         std::true_type) const
       {
-        // The point must lie in both volumes to lie in its intersection.
-        return surface1.LiesInside(x) && surface2.LiesInside(x);
+        polyhedron.GetAttributes(ray, distance, part, intersection);
+      }
+
+      void GetAttributes(const Ray ray, const float distance,
+                         const int part, Intersection& intersection,
+                         std::false_type) const
+      {
+        if (part % 2 == 0)
+          surface1.GetAttributes(ray, distance, part / 2, intersection);
+        else
+          surface2.GetAttributes(ray, distance, part / 2, intersection);
+      }
+
+      bool GetBoundingBox(BoundingBox& box, std::true_type) const
+      {
+        // The polyhedron knows exactly where its corners are.
+        return polyhedron.GetBoundingBox(box);
+      }
+
+      bool GetBoundingBox(BoundingBox& box, std::false_type) const
+      {
+        BoundingBox box1, box2;
+        const bool bounded1 = surface1.GetBoundingBox(box1);
+        const bool bounded2 = surface2.GetBoundingBox(box2);
+
+        // The intersection lies within both volumes, so if any of the
+        // two is bounded, the intersection is bounded as well.
+        if (bounded1 && bounded2) box = Overlap(box1, box2);
+        else if (bounded1) box = box1;
+        else if (bounded2) box = box2;
+        else return false;
+
+        return true;
       }
   };
 
+  /// Adds the bounding plane of a space partitioning to the polyhedron.
+  inline void AddPlanes(const SpacePartitioning& surface,
+                        ConvexPolyhedron& polyhedron)
+  {
+    polyhedron.AddPlane(surface.normal, surface.offset);
+  }
+
+  /// Adds all bounding planes of a compound of space partitionings to
+  /// the polyhedron.
+  template <typename T1, typename T2>
+  void AddPlanes(const IntersectionCompound<T1, T2>& compound,
+                 ConvexPolyhedron& polyhedron)
+  {
+    AddPlanes(compound.surface1, polyhedron);
+    AddPlanes(compound.surface2, polyhedron);
+  }
+
   typedef IntersectionCompound<Sphere, Sphere>
           ConvexLens;
 
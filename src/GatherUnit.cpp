@@ -16,17 +16,28 @@
 
 #include "GatherUnit.h"
 
+#include <algorithm>
+#include <cmath>
 #include "PlotUnit.h"
 
 using namespace Luculentus;
 
-GatherUnit::GatherUnit(const int width, const int height)
+GatherUnit::GatherUnit(const int width, const int height, const int tilesX,
+                       const int tilesY, const bool noise)
   : imageWidth(width)
   , imageHeight(height)
+  , tilesPerRow(tilesX)
+  , tilesPerColumn(tilesY)
+  , estimateNoise(noise)
+  , paths(0.0)
+  , halfPaths(0.0)
+  , nextIsHalf(true)
 {
   // Allocate a buffer to store the tristimulus values,
   // and fill it with black.
   tristimulusBuffer.resize(imageWidth * imageHeight, ZeroVector3());
+  if (estimateNoise)
+    halfBuffer.resize(imageWidth * imageHeight, ZeroVector3());
 }
 
 void GatherUnit::Accumulate(PlotUnit& plotUnit)
@@ -37,6 +48,77 @@ void GatherUnit::Accumulate(PlotUnit& plotUnit)
     tristimulusBuffer[i] += plotUnit.tristimulusBuffer[i];
   }
 
+  paths += plotUnit.plottedPaths;
+
+  if (estimateNoise && nextIsHalf)
+  {
+    for (int i = 0; i < imageWidth * imageHeight; i++)
+    {
+      halfBuffer[i] += plotUnit.tristimulusBuffer[i];
+    }
+
+    halfPaths += plotUnit.plottedPaths;
+  }
+
+  nextIsHalf = !nextIsHalf;
+
   // Then clear the buffer of the plot unit, so it can be recycled.
   plotUnit.Clear();
 }
+
+void GatherUnit::UpdateTileDensities()
+{
+  if (!estimateNoise) return;
+
+  const int numberOfTiles = tilesPerRow * tilesPerColumn;
+
+  // The estimates are meaningless until both halves have some paths
+  // for every tile
+  const double minPaths = 256.0 * numberOfTiles;
+  if (halfPaths < minPaths || paths - halfPaths < minPaths) return;
+
+  // Compare the average of a path in both halves, per tile. The error
+  // is relative to the square root of the intensity, so that dark tiles
+  // still count, but less than bright ones.
+  std::vector<float> differences(numberOfTiles, 0.0f);
+  std::vector<float> intensities(numberOfTiles, 0.0f);
+  const float halfScale = static_cast<float>(1.0 / halfPaths);
+  const float otherScale = static_cast<float>(1.0 / (paths - halfPaths));
+
+  for (int y = 0; y < imageHeight; y++)
+  {
+    const int tileY = y * tilesPerColumn / imageHeight;
+    for (int x = 0; x < imageWidth; x++)
+    {
+      const int tile = tileY * tilesPerRow + x * tilesPerRow / imageWidth;
+      const Vector3 half = halfBuffer[y * imageWidth + x];
+      const Vector3 other = tristimulusBuffer[y * imageWidth + x] - half;
+      const Vector3 a = half * halfScale;
+      const Vector3 b = other * otherScale;
+
+      differences[tile] += std::abs(a.x - b.x) + std::abs(a.y - b.y)
+                         + std::abs(a.z - b.z);
+      intensities[tile] += a.x + a.y + a.z + b.x + b.y + b.z;
+    }
+  }
+
+  float total = 0.0f;
+  for (int i = 0; i < numberOfTiles; i++)
+  {
+    differences[i] = intensities[i] > 0.0f
+                   ? differences[i] / std::sqrt(intensities[i]) : 0.0f;
+    total += differences[i];
+  }
+
+  if (total <= 0.0f) return;
+
+  // A part of the rays is still spread evenly, so no tile is ever left
+  // out, and photons never count more than a few times
+  const float uniformPart = 0.2f;
+  tileDensities.resize(numberOfTiles);
+  for (int i = 0; i < numberOfTiles; i++)
+  {
+    tileDensities[i] = uniformPart / numberOfTiles
+                     + (1.0f - uniformPart) * differences[i] / total;
+  }
+}
@@ -34,15 +34,48 @@ namespace Luculentus
       /// Height of the canvas (in pixels).
       const int imageHeight;
 
+      /// The number of tiles across the width of the canvas.
+      const int tilesPerRow;
+
+      /// The number of tiles across the height of the canvas.
+      const int tilesPerColumn;
+
       /// The buffer of tristimulus values.
       std::vector<Vector3> tristimulusBuffer;
 
+      /// Whether the noise per tile is estimated at all.
+      const bool estimateNoise;
+
+      /// The tristimulus values of every other PlotUnit only. Together
+      /// with the full buffer, this gives two independent estimates of
+      /// the image, and the difference between them shows how noisy it
+      /// still is. Empty if the noise is not estimated.
+      std::vector<Vector3> halfBuffer;
+
+      /// The number of paths in the full buffer and in the half buffer.
+      double paths, halfPaths;
+
+      /// For every tile, row by row, the chance that a camera ray should
+      /// go through it, or nothing if the noise is not known yet.
+      std::vector<float> tileDensities;
+
       /// Constructs a new gather unit that will gather a canvas of the
-      /// specified size.
-      GatherUnit(const int width, const int height);
+      /// specified size, and optionally estimate the noise per tile.
+      GatherUnit(const int width, const int height, const int tilesX,
+                 const int tilesY, const bool noise);
 
       /// Add the results of the PlotUnit to the canvas,
       /// and then clears the PlotUnit, so it can be recycled.
       void Accumulate(PlotUnit& plotUnit);
+
+      /// Estimates the noise of every tile, and spreads camera rays over
+      /// the tiles accordingly. Does nothing if the noise is not
+      /// estimated.
+      void UpdateTileDensities();
+
+    private:
+
+      /// Whether the next PlotUnit goes into the half buffer as well.
+      bool nextIsHalf;
   };
 }
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include "Vector3.h"
 
 namespace Luculentus
@@ -34,4 +36,20 @@ namespace Luculentus
     /// Distance between the intersection position and the ray origin.
     float distance;
   };
+
+  /// Returns the origin of a ray that leaves the surface at the
+  /// position in the specified direction. The origin lies just off the
+  /// surface, on the side that the ray goes to, so that rounding errors
+  /// in the position cannot make the ray hit the same surface again.
+  /// Those errors grow with the magnitude of the position, and so does
+  /// the offset.
+  inline Vector3 GetRayOrigin(const Vector3 position, const Vector3 normal,
+                              const Vector3 direction)
+  {
+    const float magnitude = std::max(std::max(1.0f, std::abs(position.x)),
+      std::max(std::abs(position.y), std::abs(position.z)));
+    const float offset = Dot(direction, normal) < 0.0f
+                       ? -1.0e-5f * magnitude : 1.0e-5f * magnitude;
+    return position + normal * offset;
+  }
 }
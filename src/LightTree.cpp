@@ -0,0 +1,219 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "LightTree.h"
+
+#include <algorithm>
+
+using namespace Luculentus;
+
+void LightTree::Build(const std::vector<Light>& lights)
+{
+  probabilities.clear();
+  aliasTable.clear();
+  nodes.clear();
+  leaves.clear();
+  if (lights.empty()) return;
+
+  const int n = static_cast<int>(lights.size());
+  float totalPower = 0.0f;
+  for (auto& light : lights) totalPower += light.power;
+
+  // Lights without any power are still picked sometimes, if all of them
+  // are like that
+  for (auto& light : lights)
+  {
+    probabilities.push_back(totalPower > 0.0f
+                            ? light.power / totalPower : 1.0f / n);
+  }
+
+  BuildAliasTable();
+  if (n <= maxAliasedLights) return;
+
+  std::vector<int> indices(n);
+  for (int i = 0; i < n; i++) indices[i] = i;
+  leaves.resize(n);
+  BuildNode(lights, indices, 0, n);
+}
+
+void LightTree::BuildAliasTable()
+{
+  // Every entry gets an equal share of the total chance. Entries with
+  // less than their share are topped up by an entry with more.
+  const int n = static_cast<int>(probabilities.size());
+  aliasTable.resize(n);
+  std::vector<float> shares(n);
+  std::vector<int> small, large;
+
+  for (int i = 0; i < n; i++)
+  {
+    shares[i] = probabilities[i] * n;
+    if (shares[i] < 1.0f) small.push_back(i); else large.push_back(i);
+  }
+
+  while (!small.empty() && !large.empty())
+  {
+    const int s = small.back(); small.pop_back();
+    const int l = large.back(); large.pop_back();
+
+    aliasTable[s].threshold = shares[s];
+    aliasTable[s].alias = l;
+
+    shares[l] -= 1.0f - shares[s];
+    if (shares[l] < 1.0f) small.push_back(l); else large.push_back(l);
+  }
+
+  // What is left is a full share, up to rounding errors
+  small.insert(small.end(), large.begin(), large.end());
+  for (int i : small)
+  {
+    aliasTable[i].threshold = 1.0f;
+    aliasTable[i].alias = i;
+  }
+}
+
+void LightTree::BuildNode(const std::vector<Light>& lights,
+                          std::vector<int>& indices, const int begin,
+                          const int end)
+{
+  const int nodeIndex = static_cast<int>(nodes.size());
+
+  Node node;
+  node.box = EmptyBoundingBox();
+  node.power = 0.0f;
+  for (int i = begin; i < end; i++)
+  {
+    node.box = Union(node.box, lights[indices[i]].box);
+    node.power += lights[indices[i]].power;
+  }
+  nodes.push_back(node);
+
+  if (end - begin == 1)
+  {
+    nodes[nodeIndex].offset = indices[begin];
+    nodes[nodeIndex].isLeaf = true;
+    leaves[indices[begin]] = nodeIndex;
+    return;
+  }
+
+  // Split at the median along the longest axis of the box, so that
+  // nearby lights end up in the same subtree
+  const Vector3 size = node.box.max - node.box.min;
+  const int axis = size.x >= size.y && size.x >= size.z ? 0
+                 : size.y >= size.z ? 1 : 2;
+  const int middle = (begin + end) / 2;
+  std::nth_element(indices.begin() + begin, indices.begin() + middle,
+                   indices.begin() + end, [&](const int a, const int b)
+  {
+    const Vector3 ca = lights[a].box.GetCentre();
+    const Vector3 cb = lights[b].box.GetCentre();
+    return axis == 0 ? ca.x < cb.x : axis == 1 ? ca.y < cb.y : ca.z < cb.z;
+  });
+
+  BuildNode(lights, indices, begin, middle);
+  nodes[nodeIndex].offset = static_cast<int>(nodes.size());
+  nodes[nodeIndex].isLeaf = false;
+  BuildNode(lights, indices, middle, end);
+}
+
+float LightTree::GetImportance(const int node, const Vector3 position) const
+{
+  // The power falls off with the square of the distance, but not closer
+  // than the size of the box, so that a shading point near or inside a
+  // cluster does not favour it without bound
+  const BoundingBox box = nodes[node].box;
+  const float distanceSquared = (box.GetCentre() - position)
+                               .MagnitudeSquared();
+  const float sizeSquared = (box.max - box.min).MagnitudeSquared() * 0.25f;
+  return nodes[node].power / std::max(distanceSquared,
+                                      std::max(sizeSquared, 1.0e-12f));
+}
+
+float LightTree::GetFirstChildChance(const int node,
+                                     const Vector3 position) const
+{
+  const float first = GetImportance(node + 1, position);
+  const float second = GetImportance(nodes[node].offset, position);
+  if (first + second <= 0.0f) return 0.5f;
+  return first / (first + second);
+}
+
+int LightTree::PickByPower(const float u, float& chance) const
+{
+  const int n = static_cast<int>(aliasTable.size());
+  const float scaled = u * n;
+  const int entry = std::min(n - 1, static_cast<int>(scaled));
+  const int light = scaled - entry < aliasTable[entry].threshold
+                  ? entry : aliasTable[entry].alias;
+  chance = probabilities[light];
+  return light;
+}
+
+int LightTree::Pick(const Vector3 position, float u, float& chance) const
+{
+  if (nodes.empty()) return PickByPower(u, chance);
+
+  // Descend the tree, and reuse the number for the next decision by
+  // stretching the part of the chosen child to the unit interval
+  chance = 1.0f;
+  int node = 0;
+  while (!nodes[node].isLeaf)
+  {
+    const float p = GetFirstChildChance(node, position);
+    if (u < p)
+    {
+      u = u / p;
+      chance *= p;
+      node = node + 1;
+    }
+    else
+    {
+      u = std::min((u - p) / (1.0f - p), 0.99999994f);
+      chance *= 1.0f - p;
+      node = nodes[node].offset;
+    }
+  }
+
+  return nodes[node].offset;
+}
+
+float LightTree::GetChance(const Vector3 position, const int light) const
+{
+  if (nodes.empty()) return probabilities[light];
+
+  // Follow the same decisions down to the leaf of the light; a subtree
+  // covers a contiguous range of nodes
+  const int leaf = leaves[light];
+  float chance = 1.0f;
+  int node = 0;
+  while (node != leaf)
+  {
+    const float p = GetFirstChildChance(node, position);
+    if (leaf < nodes[node].offset)
+    {
+      chance *= p;
+      node = node + 1;
+    }
+    else
+    {
+      chance *= 1.0f - p;
+      node = nodes[node].offset;
+    }
+  }
+
+  return chance;
+}
@@ -0,0 +1,135 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <vector>
+#include "BoundingBox.h"
+
+namespace Luculentus
+{
+  /// Picks which light to sample directly. With few lights, a light is
+  /// picked in proportion to its power from an alias table, in constant
+  /// time. With many lights, the tree is descended from the root, and
+  /// at every node the child that is estimated to contribute the most
+  /// light to the shading point is the most likely to be picked.
+  class LightTree
+  {
+    public:
+
+      /// A light as far as picking is concerned.
+      struct Light
+      {
+        /// The box that contains the light.
+        BoundingBox box;
+
+        /// The power that the light emits, in arbitrary units.
+        float power;
+      };
+
+      /// The largest number of lights that are picked with the alias
+      /// table. Beyond this, the position of the shading point is taken
+      /// into account.
+      static const int maxAliasedLights = 16;
+
+      /// Builds the table or the tree over the lights. Light indices
+      /// refer to positions in this array.
+      void Build(const std::vector<Light>& lights);
+
+      /// Returns whether there are no lights to pick.
+      inline bool IsEmpty() const { return probabilities.empty(); }
+
+      /// Picks a light for the shading point with the uniformly
+      /// distributed number u, and returns its index, and the chance
+      /// that it was picked.
+      int Pick(const Vector3 position, float u, float& chance) const;
+
+      /// Returns the chance that Pick returns the light for the shading
+      /// point.
+      float GetChance(const Vector3 position, const int light) const;
+
+      /// Picks a light in proportion to its power only, such as a light
+      /// for a light path to start from, and returns its index, and the
+      /// chance that it was picked.
+      int PickByPower(const float u, float& chance) const;
+
+      /// Returns the chance that PickByPower returns the light.
+      inline float GetPowerChance(const int light) const
+      {
+        return probabilities[light];
+      }
+
+    private:
+
+      struct Node
+      {
+        /// The box that contains all lights below this node.
+        BoundingBox box;
+
+        /// The total power of the lights below this node.
+        float power;
+
+        /// For a leaf, the index of its light. For an interior node,
+        /// the index of its second child; the first child directly
+        /// follows the node.
+        int offset;
+
+        /// Whether the node holds a single light.
+        bool isLeaf;
+      };
+
+      /// An entry of the alias table: the light of the entry is picked
+      /// with the chance of the threshold, the alias otherwise.
+      struct AliasEntry
+      {
+        float threshold;
+        int alias;
+      };
+
+      /// The chance of picking every light by power, empty if there are
+      /// no lights.
+      std::vector<float> probabilities;
+
+      /// The alias table of the probabilities.
+      std::vector<AliasEntry> aliasTable;
+
+      /// The nodes of the tree, in depth-first order, the root first, if
+      /// there are many lights.
+      std::vector<Node> nodes;
+
+      /// For every light, the index of its leaf.
+      std::vector<int> leaves;
+
+      /// Builds the alias table for the probabilities.
+      void BuildAliasTable();
+
+      /// Recursively builds the node for the lights in the range, and
+      /// appends it and its children to the nodes.
+      void BuildNode(const std::vector<Light>& lights,
+                     std::vector<int>& indices, const int begin,
+                     const int end);
+
+      /// Returns an estimate of the light that the node contributes to
+      /// the shading point.
+      float GetImportance(const int node, const Vector3 position) const;
+
+      /// Returns the chance that the first child of the interior node is
+      /// picked for the shading point.
+      float GetFirstChildChance(const int node,
+                                const Vector3 position) const;
+  };
+}
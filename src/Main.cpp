@@ -16,16 +16,20 @@
 
 #include "UserInterface.h"
 #include "Raytracer.h"
+#include "RenderSettings.h"
 
 using namespace Luculentus;
 
 int main(int argc, char** argv)
 {
+  // Read the render settings before GTK takes its arguments.
+  const RenderSettings settings = ParseRenderSettings(argc, argv);
+
   // Build the UI to display the rendered image.
   UserInterface ui(argc, argv);
 
   // Create the path tracer itself.
-  Raytracer raytracer(ui);
+  Raytracer raytracer(ui, settings);
 
   // Display a black image to start with.
   std::vector<std::uint8_t> blackBuffer(1280 * 720 * 3, 0);
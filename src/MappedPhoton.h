@@ -16,18 +16,41 @@
 
 #pragma once
 
+#include <cstdint>
+#include "Spectrum.h"
+
 namespace Luculentus
 {
   struct MappedPhoton
   {
-    /// Screen position.
+    /// Screen position of the hero wavelength.
     float x, y;
 
     /// The probability that a simulated photon hit the screen at this
-    /// position.
-    float probability;
+    /// position, for every wavelength of the path.
+    Spectrum probability;
 
-    /// The wavelength of the simulated photon (in nm).
+    /// The hero wavelength of the simulated photons (in nm), the
+    /// others follow from it, see WavelengthDistribution.
     float wavelength;
   };
+
+  /// A mapped photon in half the space, the way trace units hand them to
+  /// plot units. Encoded by TraceUnit, decoded by PlotUnit.
+  struct PackedPhoton
+  {
+    /// Screen position of the hero wavelength, where 0 and 65535 are
+    /// the edges of the screen enlarged by TraceUnit::screenScale.
+    std::uint16_t x, y;
+
+    /// The hero wavelength, where 0 is 380 nm and 65535 is 780 nm.
+    std::uint16_t wavelength;
+
+    /// Unused, so the probabilities start at eight bytes.
+    std::uint16_t padding;
+
+    /// The probability for every wavelength, as IEEE half-precision
+    /// floats.
+    std::uint16_t probability[Spectrum::size];
+  };
 }
@@ -22,6 +22,13 @@
 
 using namespace Luculentus;
 
+bool Material::IsDispersive() const
+{
+  return false;
+}
+
+// --------------------
+
 Ray ClayMaterial::GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const
@@ -47,6 +54,19 @@ Ray ClayMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+float ClayMaterial::GetProbability(const Ray, const Intersection,
+                                  const Ray, const float wavelength) const
+{
+  // The direction is picked with a cosine-weighted distribution,
+  // so only the reflectance remains
+  return GetReflectance(wavelength);
+}
+
+float ClayMaterial::GetReflectance(const float) const
+{
+  return 1.0f;
+}
+
 // --------------------
 
 DiffuseGreyMaterial::DiffuseGreyMaterial(const float refl)
@@ -61,6 +81,11 @@ Ray DiffuseGreyMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+float DiffuseGreyMaterial::GetReflectance(const float) const
+{
+  return reflectance;
+}
+
 // --------------------
 
 DiffuseColouredMaterial::DiffuseColouredMaterial(const float refl,
@@ -74,15 +99,20 @@ Ray DiffuseColouredMaterial::GetNewRay(const Ray incomingRay,
                                        const Intersection intersection,
                                        MonteCarloUnit& monteCarloUnit) const
 {
-  float p = (wavelength - incomingRay.wavelength) / deviation;
-  float q = std::exp(-0.5f * p * p);
-  
-  Ray newRay = DiffuseGreyMaterial::GetNewRay(incomingRay,
-    intersection, monteCarloUnit);
-  newRay.probability *= q;
+  // The reflectance is the same as for direct lighting
+  Ray newRay = ClayMaterial::GetNewRay(incomingRay, intersection,
+                                       monteCarloUnit);
+  newRay.probability *= GetReflectance(incomingRay.wavelength);
   return newRay;
 }
 
+float DiffuseColouredMaterial::GetReflectance(const float wavel) const
+{
+  float p = (wavelength - wavel) / deviation;
+  float q = std::exp(-0.5f * p * p);
+  return reflectance * q;
+}
+
 // --------------------
 
 Ray PerfectMirrorMaterial::GetNewRay(const Ray incomingRay,
@@ -103,6 +133,12 @@ Ray PerfectMirrorMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+float PerfectMirrorMaterial::GetProbability(const Ray, const Intersection,
+                                           const Ray, const float) const
+{
+  return 1.0f;
+}
+
 // --------------------
 
 GlossyMirrorMaterial::GlossyMirrorMaterial(const float gloss)
@@ -143,6 +179,12 @@ Ray GlossyMirrorMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+float GlossyMirrorMaterial::GetProbability(const Ray, const Intersection,
+                                          const Ray, const float) const
+{
+  return 1.0f;
+}
+
 // --------------------
 
 BrushedMetalMaterial::BrushedMetalMaterial(const float gloss,
@@ -190,6 +232,12 @@ Ray BrushedMetalMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+float BrushedMetalMaterial::GetProbability(const Ray, const Intersection,
+                                          const Ray, const float) const
+{
+  return 1.0f;
+}
+
 // --------------------
 
 Ray RefractiveMaterial::GetNewRay(const Ray incomingRay,
@@ -249,6 +297,17 @@ Ray RefractiveMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+bool RefractiveMaterial::IsDispersive() const
+{
+  return true;
+}
+
+float RefractiveMaterial::GetProbability(const Ray, const Intersection,
+                                        const Ray, const float) const
+{
+  return 1.0f;
+}
+
 // --------------------
 
 float Bk7GlassMaterial::GetIndexOfRefraction(const float wavelength) const
@@ -307,9 +366,22 @@ Ray SoapBubbleMaterial::GetNewRay(const Ray incomingRay,
     newRay.direction = incomingRay.direction;
   }
 
+  newRay.probability = GetProbability(incomingRay, intersection, newRay,
+                                      incomingRay.wavelength);
+
+  newRay.wavelength = incomingRay.wavelength;
+  newRay.origin = intersection.position;
+  
+  return newRay;
+}
+
+float SoapBubbleMaterial::GetProbability(const Ray,
+                                         const Intersection intersection,
+                                         const Ray newRay,
+                                         const float wavelength) const
+{
   // Take a phase shift from 0 - 2pi based on the wavelength.
-  const float phaseShift = (incomingRay.wavelength - 380.0f)
-                         / 200.0f * (float)pi;
+  const float phaseShift = (wavelength - 380.0f) / 200.0f * (float)pi;
 
   // Then calculate the probability for this wavelength based on the
   // angles between rays and the normal. Please note that this is by no
@@ -318,14 +390,9 @@ Ray SoapBubbleMaterial::GetNewRay(const Ray incomingRay,
     Dot(newRay.direction, intersection.normal)));
   const float cosTheta = std::min(0.999f, std::max(-0.999f,
     Dot(newRay.direction, intersection.tangent)));
-  newRay.probability = std::cos(phaseShift - std::acos(cosPhi) * 3.0f
-                                - std::acos(cosTheta) * 2.0f
-                                + (float)pi * 0.5f) * 0.1f + 0.9f;
-
-  newRay.wavelength = incomingRay.wavelength;
-  newRay.origin = intersection.position;
-  
-  return newRay;
+  return std::cos(phaseShift - std::acos(cosPhi) * 3.0f
+                  - std::acos(cosTheta) * 2.0f
+                  + (float)pi * 0.5f) * 0.1f + 0.9f;
 }
 
 // --------------------
@@ -355,9 +422,22 @@ Ray IridescentMaterial::GetNewRay(const Ray incomingRay,
                    + (reflection * (1.0f - glossiness));
   newRay.direction.Normalise();
 
+  newRay.probability = GetProbability(incomingRay, intersection, newRay,
+                                      incomingRay.wavelength);
+
+  newRay.wavelength = incomingRay.wavelength;
+  newRay.origin = intersection.position;
+  
+  return newRay;
+}
+
+float IridescentMaterial::GetProbability(const Ray,
+                                         const Intersection intersection,
+                                         const Ray newRay,
+                                         const float wavelength) const
+{
   // Take a phase shift from 0 - 2pi based on the wavelength.
-  const float phaseShift = (incomingRay.wavelength - 380.0f)
-                         / 200.0f * (float)pi;
+  const float phaseShift = (wavelength - 380.0f) / 200.0f * (float)pi;
 
   // Then calculate the probability for this wavelength based on the
   // angles between rays and the normal. Please note that this is by n
@@ -366,11 +446,6 @@ Ray IridescentMaterial::GetNewRay(const Ray incomingRay,
     Dot(newRay.direction, intersection.normal)));
   const float cosTheta = std::min(0.999f, std::max(-0.999f,
     Dot(newRay.direction, intersection.tangent)));
-  newRay.probability = std::cos(phaseShift + std::acos(cosPhi) * 3.0f
-                            - std::acos(cosTheta) * 2.0f) * 0.5f + 0.5f;
-
-  newRay.wavelength = incomingRay.wavelength;
-  newRay.origin = intersection.position;
-  
-  return newRay;
+  return std::cos(phaseShift + std::acos(cosPhi) * 3.0f
+                  - std::acos(cosTheta) * 2.0f) * 0.5f + 0.5f;
 }
@@ -32,6 +32,19 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const = 0;
+
+      /// Returns whether the direction of the new ray depends on the
+      /// wavelength, so that it is only valid for the wavelength of the
+      /// incoming ray.
+      virtual bool IsDispersive() const;
+
+      /// Returns the probability that GetNewRay would have given the new
+      /// ray, had the incoming ray had the specified wavelength. This
+      /// is only meaningful if the material is not dispersive.
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const = 0;
   };
 
   /// A perfectly diffuse, perfectly reflecting all wavelengths, material.
@@ -42,6 +55,15 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
+
+      /// Returns the fraction of light of the specified wavelength that
+      /// is reflected, the probability of the rays from GetNewRay.
+      virtual float GetReflectance(const float wavelength) const;
   };
 
   /// Same as clay, but not perfectly white; it absorbes energy.
@@ -59,6 +81,8 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetReflectance(const float wavelength) const;
   };
 
   /// Reflects light of a certain wavelength better than others,
@@ -78,6 +102,8 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetReflectance(const float wavelength) const;
   };
 
   /// Reflects all light perfectly along the same (but opposite) angle.
@@ -88,6 +114,11 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                       const Intersection intersection,
                       MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
   };
 
   /// Blends between perfect reflection and diffuse.
@@ -104,6 +135,11 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
   };
 
   class BrushedMetalMaterial : public Material
@@ -123,6 +159,11 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
   };
 
   class RefractiveMaterial : public Material
@@ -133,6 +174,14 @@ namespace Luculentus
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
 
+      /// The angle of refraction depends on the wavelength.
+      virtual bool IsDispersive() const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
+
       virtual float GetIndexOfRefraction(const float wavelength) const = 0;
   };
 
@@ -159,6 +208,11 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
   };
 
   /// A completely fictional but very interesting material.
@@ -169,5 +223,10 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetProbability(const Ray incomingRay,
+                                   const Intersection intersection,
+                                   const Ray newRay,
+                                   const float wavelength) const;
   };
 }
@@ -20,16 +20,50 @@
 
 using namespace Luculentus;
 
+MonteCarloUnit::MonteCarloUnit(const std::uint32_t unitIndex)
+  : sampler(std::make_shared<RandomSampler>())
+  , unit(unitIndex)
+  , batchSize(1u << 20)
+{
+  SetStream(0, 0);
+}
+
+MonteCarloUnit::MonteCarloUnit(const std::uint32_t unitIndex,
+                               std::shared_ptr<const Sampler> samplerForUnit,
+                               const std::uint32_t samplesPerBatch)
+  : sampler(samplerForUnit)
+  , unit(unitIndex)
+  , batchSize(samplesPerBatch)
+{
+  SetStream(0, 0);
+}
+
+void MonteCarloUnit::SetStream(const std::uint32_t batch,
+                               const std::uint32_t sample,
+                               const std::uint32_t position)
+{
+  // All samples of the unit are consecutive points of one sequence.
+  // When the index no longer fits in 32 bits, continue with another
+  // sequence.
+  const std::uint64_t n = static_cast<std::uint64_t>(batch) * batchSize
+                        + sample;
+  index = static_cast<std::uint32_t>(n);
+  seed = Sampler::Hash(Sampler::Hash(unit)
+                     + static_cast<std::uint32_t>(n >> 32));
+  dimension = position;
+  bufferedGroup = 1;
+}
+
+void MonteCarloUnit::FillBuffer()
+{
+  bufferedGroup = dimension & ~(groupSize - 1);
+  sampler->Fill(seed, index, bufferedGroup, buffer, groupSize);
+}
 
-MonteCarloUnit::MonteCarloUnit(const unsigned long randomSeed)
-  : biUnitDistribution(-1.0f, 1.0f)
-  , unitDistribution(0.0f, 1.0f)
-  , longitudeDistribution(0.0f, static_cast<float>(pi * 2.0f))
-  , latitudeDistribution(static_cast<float>(-pi * 0.5f),
-      static_cast<float>(pi * 0.5f))
-  , wavelengthDistribution(380.0f, 780.0f)
+void MonteCarloUnit::FillUnit(float* values, const int count)
 {
-  randomEngine.seed(randomSeed);
+  sampler->Fill(seed, index, dimension, values, count);
+  dimension += count;
 }
 
 Vector3 MonteCarloUnit::GetCosineDistributedHemisphereVector()
@@ -16,56 +16,75 @@
 
 #pragma once
 
-#include <random>
+#include <cstdint>
+#include <memory>
+#include "Constants.h"
+#include "Sampler.h"
 #include "Vector3.h"
 
 namespace Luculentus
 {
-  /// An entropy provider that can be kept per-thread.
+  /// An entropy provider that can be kept per-thread. Numbers are taken
+  /// from a sampler: every stream is a point of the sampler, and the
+  /// position in the stream is the dimension. A stream is identified by
+  /// the unit, a batch and a sample, so samples can be generated in any
+  /// order, and the state is only a few integers.
   class MonteCarloUnit
   {
     public:
 
-      /// Random generator.
-      std::mt19937 randomEngine;
+      /// Initializes a new entropy provider for the specified unit, that
+      /// takes independent random numbers, at the start of the stream
+      /// for batch 0 and sample 0.
+      MonteCarloUnit(const std::uint32_t unitIndex);
 
-      /// Uniform distribution in the range -1 .. 1.
-      std::uniform_real_distribution<float> biUnitDistribution;
+      /// Initializes a new entropy provider for the specified unit that
+      /// takes numbers from the sampler. Every batch consists of the
+      /// specified number of samples.
+      MonteCarloUnit(const std::uint32_t unitIndex,
+                     std::shared_ptr<const Sampler> samplerForUnit,
+                     const std::uint32_t samplesPerBatch);
 
-      /// Uniform distribution in the range 0 .. 1.
-      std::uniform_real_distribution<float> unitDistribution;
+      /// Continues with the stream of the specified batch and sample of
+      /// this unit, at the specified position in the stream.
+      void SetStream(const std::uint32_t batch, const std::uint32_t sample,
+                     const std::uint32_t position = 0);
 
-      /// Uniform distribution in the range 0 .. 2pi.
-      std::uniform_real_distribution<float> longitudeDistribution;
+      /// Returns how many numbers were taken from the current stream.
+      inline std::uint32_t GetPosition() const { return dimension; }
 
-      /// Uniform distribution in the range -pi/2 .. pi/2.
-      std::uniform_real_distribution<float> latitudeDistribution;
+      /// Continues the current stream at the specified position.
+      inline void SetPosition(const std::uint32_t position)
+      { dimension = position; }
 
-      /// Uniform distribution in the range 380 .. 780.
-      std::uniform_real_distribution<float> wavelengthDistribution;
-
-      /// Initializes a new entropy provider with the specified seed.
-      MonteCarloUnit(const long unsigned int seed);
+      /// Fills the buffer with count reals in the range 0 .. 1, the same
+      /// as count calls to GetUnit would return, but faster.
+      void FillUnit(float* values, const int count);
 
       /// Returns a random real in the range -1 .. 1.
       inline float GetBiUnit()
-      { return biUnitDistribution(randomEngine); }
+      { return GetUnit() * 2.0f - 1.0f; }
 
       /// Returns a random real in the range 0 .. 1.
       inline float GetUnit()
-      { return unitDistribution(randomEngine); }
+      {
+        // Samplers are faster when they generate a few dimensions at a
+        // time, so keep a group of dimensions around
+        if ((dimension & ~(groupSize - 1)) != bufferedGroup) FillBuffer();
+        return buffer[dimension++ & (groupSize - 1)];
+      }
 
       /// Returns a random real in the range 0 .. 2pi.
       inline float GetLongitude()
-      { return longitudeDistribution(randomEngine); }
+      { return GetUnit() * static_cast<float>(pi * 2.0); }
 
       /// Returns a random real in the range -pi/2 .. pi/2.
       inline float GetLatitude()
-      { return latitudeDistribution(randomEngine); }
+      { return (GetUnit() - 0.5f) * static_cast<float>(pi); }
 
       /// Returns a random real in the range 380 .. 780.
       inline float GetWavelength()
-      { return wavelengthDistribution(randomEngine); }
+      { return GetUnit() * 400.0f + 380.0f; }
 
       /// Returns a random unit vector, pointing up along the z-axis,
       /// in the hemisphere bounded by the xy-plane, with a
@@ -76,5 +95,38 @@ namespace Luculentus
       /// in the hemisphere bounded by the xy-plane, with a uniform
       /// probability.
       Vector3 GetHemisphereVector();
+
+    private:
+
+      /// The sequence that the numbers are taken from.
+      std::shared_ptr<const Sampler> sampler;
+
+      /// The unit that this provider belongs to.
+      std::uint32_t unit;
+
+      /// The number of samples in a batch.
+      std::uint32_t batchSize;
+
+      /// The seed of the sequence for the current stream.
+      std::uint32_t seed;
+
+      /// The point of the sequence for the current stream.
+      std::uint32_t index;
+
+      /// The position in the current stream.
+      std::uint32_t dimension;
+
+      /// The number of dimensions that GetUnit generates at once.
+      static const std::uint32_t groupSize = 4;
+
+      /// The first dimension in the buffer, or an unaligned value if the
+      /// buffer is empty.
+      std::uint32_t bufferedGroup;
+
+      /// The values of the current stream for a group of dimensions.
+      float buffer[groupSize];
+
+      /// Fills the buffer with the group of the current dimension.
+      void FillBuffer();
   };
 }
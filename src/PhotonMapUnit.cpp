@@ -0,0 +1,273 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "PhotonMapUnit.h"
+
+#include <algorithm>
+#include <cmath>
+#include "Cie1931.h"
+#include "CompiledScene.h"
+#include "Constants.h"
+#include "GatherUnit.h"
+
+using namespace Luculentus;
+
+const float PhotonMapUnit::alpha = 2.0f / 3.0f;
+const float PhotonMapUnit::initialRadius = 2.0f;
+
+PhotonMapUnit::PhotonMapUnit(const int width, const int height,
+                             const CompiledScene& scene,
+                             const RenderSettings& settings)
+  : imageWidth(width)
+  , imageHeight(height)
+  , numberOfBands((height + rowsPerBand - 1) / rowsPerBand)
+  , visiblePoints(width * height)
+  , directLight(width * height, ZeroVector3())
+  , iterations(0)
+  , wavelengthDistribution(scene, settings.wavelengths)
+  , pixelAngle(2.0f / (width - 1)
+               / scene.GetCameraAtTime(0.0f).GetScreenDistance())
+  , radiiSquared(width * height, 0.0f)
+  , photonCounts(width * height, 0.0f)
+  , flux(width * height, ZeroVector3())
+  , totalDirectLight(width * height, ZeroVector3())
+  , accumulators(width * height)
+  , emittedPhotons(0)
+  , cellSize(1.0f)
+  , bucketStarts(width * height + 1, 0)
+{
+  for (auto& accumulator : accumulators)
+  {
+    accumulator.x = 0.0f;
+    accumulator.y = 0.0f;
+    accumulator.z = 0.0f;
+    accumulator.count = 0;
+  }
+
+  PickWavelengths();
+}
+
+void PhotonMapUnit::PickWavelengths()
+{
+  // Consecutive iterations spread their hero wavelengths evenly over
+  // the distribution
+  const double unit = (iterations + 0.5) * goldenRatio;
+  const float heroWavelength = wavelengthDistribution.Sample(
+    static_cast<float>(unit - std::floor(unit)));
+
+  wavelengths = wavelengthDistribution.GetWavelengths(heroWavelength);
+  const Spectrum weights = wavelengthDistribution.GetWeights(wavelengths);
+
+  // Every wavelength is an estimate on its own, so they are averaged,
+  // and wavelengths that were likely to be picked count less
+  Cie1931::GetTristimuli(wavelengths.values, tristimuli, Spectrum::size);
+  for (int i = 0; i < Spectrum::size; i++)
+    tristimuli[i] = tristimuli[i] * (weights[i] / Spectrum::size);
+}
+
+Vector3 PhotonMapUnit::GetTristimulus(const Spectrum light) const
+{
+  Vector3 cie = ZeroVector3();
+  for (int i = 0; i < Spectrum::size; i++) cie += tristimuli[i] * light[i];
+  return cie;
+}
+
+int PhotonMapUnit::GetBucket(const int x, const int y, const int z) const
+{
+  const std::uint32_t hash = (static_cast<std::uint32_t>(x) * 73856093u)
+                           ^ (static_cast<std::uint32_t>(y) * 19349663u)
+                           ^ (static_cast<std::uint32_t>(z) * 83492791u);
+  return static_cast<int>(hash % static_cast<std::uint32_t>(
+    visiblePoints.size()));
+}
+
+void PhotonMapUnit::BuildGrid()
+{
+  const int numberOfPixels = imageWidth * imageHeight;
+
+  // Pixels that see a surface for the first time start with a radius
+  // of a few pixels at the distance of the surface
+  float maxRadiusSquared = 0.0f;
+  for (int p = 0; p < numberOfPixels; p++)
+  {
+    const VisiblePoint& point = visiblePoints[p];
+    if (!point.isValid) continue;
+
+    if (radiiSquared[p] == 0.0f)
+    {
+      const float radius = initialRadius * point.distance * pixelAngle;
+      radiiSquared[p] = radius * radius;
+    }
+
+    maxRadiusSquared = std::max(maxRadiusSquared, radiiSquared[p]);
+  }
+
+  // Cells are as wide as the largest sphere around a point, so every
+  // point overlaps at most two cells along every axis (three, if it is
+  // rounded unfortunately)
+  cellSize = std::max(2.0f * std::sqrt(maxRadiusSquared), 1e-6f);
+  const float invCellSize = 1.0f / cellSize;
+
+  // Finds the buckets of the cells that the sphere around the point of
+  // the pixel overlaps, without duplicates, and returns how many
+  const auto getBuckets = [&](const int p, int* buckets)
+  {
+    const VisiblePoint& point = visiblePoints[p];
+    const float radius = std::sqrt(radiiSquared[p]);
+    const Vector3 low = (point.position - MakeVector3(radius, radius, radius))
+                      * invCellSize;
+    const Vector3 high = (point.position + MakeVector3(radius, radius, radius))
+                       * invCellSize;
+
+    int n = 0;
+    for (int z = static_cast<int>(std::floor(low.z));
+         z <= static_cast<int>(std::floor(high.z)); z++)
+      for (int y = static_cast<int>(std::floor(low.y));
+           y <= static_cast<int>(std::floor(high.y)); y++)
+        for (int x = static_cast<int>(std::floor(low.x));
+             x <= static_cast<int>(std::floor(high.x)); x++)
+        {
+          const int bucket = GetBucket(x, y, z);
+          if (std::find(buckets, buckets + n, bucket) == buckets + n)
+            buckets[n++] = bucket;
+        }
+
+    return n;
+  };
+
+  // Count the points in every bucket first, then find where every
+  // bucket starts, and then put the points in place
+  std::fill(bucketStarts.begin(), bucketStarts.end(), 0);
+  for (int p = 0; p < numberOfPixels; p++)
+  {
+    if (!visiblePoints[p].isValid) continue;
+
+    int buckets[27];
+    const int n = getBuckets(p, buckets);
+    for (int i = 0; i < n; i++) bucketStarts[buckets[i] + 1]++;
+  }
+
+  for (int b = 0; b < numberOfPixels; b++)
+    bucketStarts[b + 1] += bucketStarts[b];
+
+  cellPoints.resize(bucketStarts[numberOfPixels]);
+  std::vector<int> ends(bucketStarts.begin(), bucketStarts.end() - 1);
+  for (int p = 0; p < numberOfPixels; p++)
+  {
+    if (!visiblePoints[p].isValid) continue;
+
+    int buckets[27];
+    const int n = getBuckets(p, buckets);
+    for (int i = 0; i < n; i++) cellPoints[ends[buckets[i]]++] = p;
+  }
+}
+
+// Adds the value to the atomic float.
+inline void AtomicAdd(std::atomic<float>& sum, const float value)
+{
+  float current = sum.load();
+  while (!sum.compare_exchange_weak(current, current + value));
+}
+
+void PhotonMapUnit::AddPhoton(const Vector3 position,
+                              const Vector3 direction, const Spectrum light,
+                              const bool dispersed)
+{
+  const float invCellSize = 1.0f / cellSize;
+  const int bucket = GetBucket(
+    static_cast<int>(std::floor(position.x * invCellSize)),
+    static_cast<int>(std::floor(position.y * invCellSize)),
+    static_cast<int>(std::floor(position.z * invCellSize)));
+
+  for (int i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; i++)
+  {
+    const int p = cellPoints[i];
+    const VisiblePoint& point = visiblePoints[p];
+
+    if ((point.position - position).MagnitudeSquared() >= radiiSquared[p])
+      continue;
+
+    // The photon must arrive at the side of the surface that the camera
+    // sees
+    if (Dot(direction, point.normal) * Dot(point.incoming, point.normal)
+        <= 0.0f) continue;
+
+    // Both paths take the weight of all wavelengths once for the hero
+    // wavelength, but the joined path must do so only once
+    Spectrum contribution = light * point.throughput;
+    if (dispersed && point.dispersed)
+      contribution = contribution * (1.0f / Spectrum::size);
+
+    const Vector3 cie = GetTristimulus(contribution);
+    Accumulator& accumulator = accumulators[p];
+    AtomicAdd(accumulator.x, cie.x);
+    AtomicAdd(accumulator.y, cie.y);
+    AtomicAdd(accumulator.z, cie.z);
+    accumulator.count++;
+  }
+}
+
+void PhotonMapUnit::AddEmittedPhotons(const int count)
+{
+  emittedPhotons += count;
+}
+
+void PhotonMapUnit::Update(GatherUnit& gatherUnit)
+{
+  const int numberOfPixels = imageWidth * imageHeight;
+  const float invEmitted = emittedPhotons > 0
+                         ? 1.0f / static_cast<float>(emittedPhotons) : 0.0f;
+  iterations++;
+
+  for (int p = 0; p < numberOfPixels; p++)
+  {
+    Accumulator& accumulator = accumulators[p];
+    const int count = accumulator.count;
+
+    // Only a part of the new photons is kept, and the radius shrinks so
+    // that the density of the photons stays the same. The flux is per
+    // emitted photon of an iteration, so iterations with a different
+    // number of photons are averaged.
+    if (count > 0)
+    {
+      const float newCount = photonCounts[p] + alpha * count;
+      const float ratio = newCount / (photonCounts[p] + count);
+      const Vector3 newFlux = MakeVector3(accumulator.x, accumulator.y,
+                                          accumulator.z) * invEmitted;
+
+      flux[p] = (flux[p] + newFlux) * ratio;
+      radiiSquared[p] *= ratio;
+      photonCounts[p] = newCount;
+    }
+
+    accumulator.x = 0.0f;
+    accumulator.y = 0.0f;
+    accumulator.z = 0.0f;
+    accumulator.count = 0;
+
+    totalDirectLight[p] += directLight[p];
+    directLight[p] = ZeroVector3();
+
+    const Vector3 reflected = radiiSquared[p] > 0.0f
+      ? flux[p] * (1.0f / (static_cast<float>(pi) * radiiSquared[p]))
+      : ZeroVector3();
+    gatherUnit.tristimulusBuffer[p] = (totalDirectLight[p] + reflected)
+                                    * (1.0f / iterations);
+  }
+
+  emittedPhotons = 0;
+  PickWavelengths();
+}
@@ -0,0 +1,189 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "RenderSettings.h"
+#include "Spectrum.h"
+#include "Vector3.h"
+#include "WavelengthDistribution.h"
+
+namespace Luculentus
+{
+  class CompiledScene;
+  class GatherUnit;
+
+  /// Holds the state of stochastic progressive photon mapping. Every
+  /// iteration, the camera finds a visible point on a diffuse surface
+  /// for every pixel, and photons from the lights that arrive near a
+  /// visible point add to the light of its pixel. The radius in which
+  /// photons count shrinks with every iteration, so the image converges
+  /// to the right one.
+  ///
+  /// All paths of an iteration carry the same wavelengths, so that
+  /// photons can be added to any visible point, even after dispersion.
+  class PhotonMapUnit
+  {
+    public:
+
+      /// A point where a camera ray, after any number of specular
+      /// bounces, hit a diffuse surface.
+      struct VisiblePoint
+      {
+        /// The position and normal of the surface.
+        Vector3 position, normal;
+
+        /// The direction of the ray that arrived at the point.
+        Vector3 incoming;
+
+        /// The importance that arrived at the point, times the
+        /// reflectance of the surface divided by pi, so a photon only has
+        /// to be multiplied by it.
+        Spectrum throughput;
+
+        /// The distance that the camera ray travelled to the point.
+        float distance;
+
+        /// Whether the camera ray hit a surface at all.
+        bool isValid;
+
+        /// Whether only the hero wavelength is left.
+        bool dispersed;
+      };
+
+      /// Width of the canvas (in pixels).
+      const int imageWidth;
+
+      /// Height of the canvas (in pixels).
+      const int imageHeight;
+
+      /// The number of rows of pixels that one Locate task handles.
+      static const int rowsPerBand = 16;
+
+      /// The number of bands of rows that cover the canvas.
+      const int numberOfBands;
+
+      /// The wavelengths of all paths of the current iteration.
+      Spectrum wavelengths;
+
+      /// The visible point of every pixel in the current iteration.
+      std::vector<VisiblePoint> visiblePoints;
+
+      /// The light that camera rays of the current iteration found
+      /// directly, or through specular bounces, in CIE XYZ.
+      std::vector<Vector3> directLight;
+
+      /// The number of iterations that were completed.
+      int iterations;
+
+      /// Prepares an empty photon map for a canvas of the specified
+      /// size.
+      PhotonMapUnit(const int width, const int height,
+                    const CompiledScene& scene,
+                    const RenderSettings& settings);
+
+      /// Converts light at the wavelengths of the current iteration to
+      /// CIE XYZ, weighted by how likely the wavelengths were picked.
+      Vector3 GetTristimulus(const Spectrum light) const;
+
+      /// Builds the spatial hash of the visible points, after they were
+      /// all located.
+      void BuildGrid();
+
+      /// Adds the light of a photon that arrived along the direction at
+      /// a diffuse surface to every visible point within its radius of
+      /// the position. This method is thread-safe.
+      void AddPhoton(const Vector3 position, const Vector3 direction,
+                     const Spectrum light, const bool dispersed);
+
+      /// Adds the number of photons that were emitted in this iteration.
+      /// This method is thread-safe.
+      void AddEmittedPhotons(const int count);
+
+      /// Adds the photons of the iteration to the pixels, shrinks the
+      /// radii, writes the image to the gather unit, and picks the
+      /// wavelengths of the next iteration.
+      void Update(GatherUnit& gatherUnit);
+
+    private:
+
+      /// The photons that arrived at a visible point in the current
+      /// iteration.
+      struct Accumulator
+      {
+        std::atomic<float> x, y, z;
+        std::atomic<int> count;
+      };
+
+      /// The fraction of the new photons that is kept when the radius
+      /// shrinks. Smaller values shrink faster.
+      static const float alpha;
+
+      /// The radius of a visible point in the first iteration, in
+      /// pixels at the distance of the point.
+      static const float initialRadius;
+
+      /// The distribution of the hero wavelengths of the iterations.
+      const WavelengthDistribution wavelengthDistribution;
+
+      /// The CIE XYZ value of every wavelength of the iteration, times
+      /// its weight.
+      Vector3 tristimuli[Spectrum::size];
+
+      /// The angle between the camera rays of neighbouring pixels.
+      const float pixelAngle;
+
+      /// For every pixel, the square of the radius in which photons
+      /// count, or zero if it had no visible point yet.
+      std::vector<float> radiiSquared;
+
+      /// For every pixel, the (fractional) number of photons that it
+      /// kept.
+      std::vector<float> photonCounts;
+
+      /// For every pixel, the light of its photons, per emitted photon,
+      /// scaled down with the radius.
+      std::vector<Vector3> flux;
+
+      /// For every pixel, the sum of the direct light of all iterations.
+      std::vector<Vector3> totalDirectLight;
+
+      /// The photons that arrived at every pixel in this iteration.
+      std::vector<Accumulator> accumulators;
+
+      /// The number of photons emitted in this iteration.
+      std::atomic<std::int64_t> emittedPhotons;
+
+      /// The width of a cell of the grid.
+      float cellSize;
+
+      /// For every bucket of the hash table, the index of its first
+      /// visible point in cellPoints, and the end of the last bucket.
+      std::vector<int> bucketStarts;
+
+      /// The pixels of the visible points in every bucket.
+      std::vector<int> cellPoints;
+
+      /// Returns the bucket of the cell with the specified coordinates.
+      int GetBucket(const int x, const int y, const int z) const;
+
+      /// Picks the wavelengths of the current iteration.
+      void PickWavelengths();
+  };
+}
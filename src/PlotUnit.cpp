@@ -17,8 +17,15 @@
 #include "PlotUnit.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "TraceUnit.h"
 #include "Cie1931.h"
+#include "CompiledScene.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 using namespace Luculentus;
 
@@ -26,6 +33,9 @@ PlotUnit::PlotUnit(const int width, const int height)
   : imageWidth(width)
   , imageHeight(height)
   , aspectRatio(static_cast<float>(width) / static_cast<float>(height))
+  , plottedPaths(0)
+  , binsPerRow((width + binSize - 1) / binSize)
+  , binsPerColumn((height + binSize - 1) / binSize)
 {
   // Allocate a buffer to store the tristimulus values,
   // and fill it with black.
@@ -35,18 +45,192 @@ PlotUnit::PlotUnit(const int width, const int height)
 void PlotUnit::Clear()
 {
   std::fill(tristimulusBuffer.begin(), tristimulusBuffer.end(), ZeroVector3());
+  plottedPaths = 0;
 }
 
 void PlotUnit::Plot(const TraceUnit& traceUnit)
 {
-  // Loop trough every mapped photon, and plot it.
-  for (auto photon : traceUnit.mappedPhotons)
+  // The lens zooms in on every wavelength differently. The amount of
+  // chromatic aberration is assumed not to change over time.
+  const Camera camera = traceUnit.scene.GetCameraAtTime(0.0f);
+
+  // Photons are weighted by how likely their wavelengths were picked.
+  const WavelengthDistribution& distribution
+    = traceUnit.wavelengthDistribution;
+
+  // Photons of consecutive packets are close together, but a batch
+  // sweeps over the entire screen several times. Sorting the photons by
+  // bin first makes every part of the buffer hot only once. The trace
+  // unit kept only the photons that carry light.
+  const int numberOfMapped = traceUnit.numberOfPhotons;
+  const int numberOfPhotons = numberOfMapped
+    + static_cast<int>(traceUnit.lightPhotons.size());
+  const int numberOfBins = binsPerRow * binsPerColumn;
+  photonBins.resize(numberOfPhotons);
+  binStarts.assign(numberOfBins + 1, 0);
+
+  for (int p = 0; p < numberOfPhotons; p++)
+  {
+    photonBins[p] = p < numberOfMapped
+      ? GetBin(traceUnit.packedPhotons[p], traceUnit.screenScale)
+      : GetBin(traceUnit.lightPhotons[p - numberOfMapped]);
+    binStarts[photonBins[p] + 1]++;
+  }
+
+  for (int b = 0; b < numberOfBins; b++) binStarts[b + 1] += binStarts[b];
+
+  binnedPhotons.resize(numberOfPhotons);
+  binEnds.assign(binStarts.begin(), binStarts.end() - 1);
+  for (int p = 0; p < numberOfPhotons; p++)
+  {
+    binnedPhotons[binEnds[photonBins[p]]++] = p;
+  }
+
+  // Then plot every wavelength of the photons, one bin at a time. They
+  // are weighted by the density of their tile already, photons of light
+  // paths landed wherever they did, not in a tile.
+  for (const int p : binnedPhotons)
+  {
+    if (p < numberOfMapped)
+      PlotPhoton(Unpack(traceUnit.packedPhotons[p], traceUnit.screenScale),
+                 camera, distribution);
+    else
+      PlotPhoton(traceUnit.lightPhotons[p - numberOfMapped], camera,
+                 distribution);
+  }
+
+  plottedPaths += TraceUnit::numberOfPaths;
+}
+
+void PlotUnit::PlotPhotons(const MappedPhoton* photons, const int count,
+                           const Camera& camera,
+                           const WavelengthDistribution& distribution)
+{
+  for (int p = 0; p < count; p++)
   {
-    // Calculate the CIE tristimulus values, given the wavelength.
-    Vector3 cie = Cie1931::GetTristimulus(photon.wavelength);
+    PlotPhoton(photons[p], camera, distribution);
+  }
+}
+
+int PlotUnit::GetBin(const MappedPhoton& photon) const
+{
+  // Map the position to a pixel the same way as PlotPixel does.
+  const float px = (photon.x * 0.5f + 0.5f) * (imageWidth - 1);
+  const float py = (photon.y * aspectRatio * 0.5f + 0.5f) * (imageHeight - 1);
+  const int x = std::max(0, std::min(imageWidth - 1, static_cast<int>(px)));
+  const int y = std::max(0, std::min(imageHeight - 1, static_cast<int>(py)));
+
+  return (y / binSize) * binsPerRow + x / binSize;
+}
+
+int PlotUnit::GetBin(const PackedPhoton& photon,
+                     const float screenScale) const
+{
+  // The same as for a photon that is not packed, relative to the centre
+  // of the screen, which the scale does not move.
+  const float px = ((photon.x * (1.0f / 65535.0f) - 0.5f) * screenScale
+                    + 0.5f) * (imageWidth - 1);
+  const float py = ((photon.y * (1.0f / 65535.0f) - 0.5f) * screenScale
+                    + 0.5f) * (imageHeight - 1);
+  const int x = std::max(0, std::min(imageWidth - 1, static_cast<int>(px)));
+  const int y = std::max(0, std::min(imageHeight - 1, static_cast<int>(py)));
+
+  return (y / binSize) * binsPerRow + x / binSize;
+}
+
+// Returns the float of an IEEE half-precision float.
+inline float FromHalf(const std::uint16_t half)
+{
+  const std::uint32_t sign = (half & 0x8000u) << 16;
+  const std::uint32_t exponent = (half >> 10) & 0x1fu;
+  const std::uint32_t mantissa = half & 0x3ffu;
+
+  // Subnormal halves are normal floats, scaled down
+  if (exponent == 0)
+  {
+    const float value = mantissa * (1.0f / 16777216.0f);
+    return sign ? -value : value;
+  }
+
+  // The exponent is biased by 15 for halves and 127 for floats
+  const std::uint32_t bits = sign
+    | ((exponent == 31 ? 255u : exponent - 15u + 127u) << 23)
+    | (mantissa << 13);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+MappedPhoton PlotUnit::Unpack(const PackedPhoton& packed,
+                              const float screenScale) const
+{
+  MappedPhoton photon;
+
+  #if defined(__F16C__)
+  // The positions and the wavelength are scaled from the first four
+  // 16-bit integers, the probabilities converted from the other four.
+  const __m128i bits = _mm_loadu_si128(
+    reinterpret_cast<const __m128i*>(&packed));
+  const __m128 fixed = _mm_cvtepi32_ps(
+    _mm_unpacklo_epi16(bits, _mm_setzero_si128()));
+  const __m128 scale = _mm_setr_ps(2.0f * screenScale / 65535.0f,
+                                   2.0f * screenScale / 65535.0f
+                                   / aspectRatio,
+                                   400.0f / 65535.0f, 0.0f);
+  const __m128 offset = _mm_setr_ps(-screenScale,
+                                    -screenScale / aspectRatio,
+                                    380.0f, 0.0f);
+  float values[4];
+  _mm_storeu_ps(values, _mm_add_ps(_mm_mul_ps(fixed, scale), offset));
+  photon.x = values[0];
+  photon.y = values[1];
+  photon.wavelength = values[2];
+
+  static_assert(Spectrum::size == 4, "A spectrum must fit in a vector.");
+  _mm_storeu_ps(photon.probability.values,
+                _mm_cvtph_ps(_mm_srli_si128(bits, 8)));
+  #else
+  photon.x = (packed.x * (2.0f / 65535.0f) - 1.0f) * screenScale;
+  photon.y = (packed.y * (2.0f / 65535.0f) - 1.0f) * screenScale
+           / aspectRatio;
+  photon.wavelength = packed.wavelength * (400.0f / 65535.0f) + 380.0f;
+
+  for (int i = 0; i < Spectrum::size; i++)
+    photon.probability[i] = FromHalf(packed.probability[i]);
+  #endif
+
+  return photon;
+}
+
+void PlotUnit::PlotPhoton(const MappedPhoton& photon, const Camera& camera,
+                          const WavelengthDistribution& distribution)
+{
+  const Spectrum wavelengths = distribution.GetWavelengths(photon.wavelength);
+  const Spectrum weights = distribution.GetWeights(wavelengths);
+  const float heroZoom = camera.GetChromaticZoom(photon.wavelength);
+
+  // Calculate the CIE tristimulus values of all wavelengths at once.
+  Vector3 cie[Spectrum::size];
+  Cie1931::GetTristimuli(wavelengths.values, cie, Spectrum::size);
+
+  for (int i = 0; i < Spectrum::size; i++)
+  {
+    if (photon.probability[i] == 0.0f) continue;
+
+    // All wavelengths left the camera in the same direction as the
+    // hero wavelength, which puts them at a different position on the
+    // screen. Scaling the position also scales the density of the
+    // photons, so they are weighted by the area of the scale.
+    const float scale = heroZoom / camera.GetChromaticZoom(wavelengths[i]);
+    const float x = photon.x * scale;
+    const float y = photon.y * scale;
+    if (std::abs(x) > 1.0f || std::abs(y * aspectRatio) > 1.0f) continue;
 
-    // Then plot the pixel into the buffer.
-    PlotPixel(photon.x, photon.y, cie * photon.probability);
+    // Then plot the pixel into the buffer. Every wavelength is an
+    // estimate on its own, so they are averaged, and wavelengths that
+    // were likely to be picked count less.
+    PlotPixel(x, y, cie[i] * (photon.probability[i] * weights[i]
+                           * scale * scale / Spectrum::size));
   }
 }
 
@@ -21,7 +21,11 @@
 
 namespace Luculentus
 {
+  class Camera;
   class TraceUnit;
+  class WavelengthDistribution;
+  struct MappedPhoton;
+  struct PackedPhoton;
 
   /// Handles plotting the results of a TraceUnit.
   class PlotUnit
@@ -40,6 +44,21 @@ namespace Luculentus
       /// The buffer of tristimulus values.
       std::vector<Vector3> tristimulusBuffer;
 
+      /// The number of paths plotted into the buffer since it was last
+      /// cleared.
+      int plottedPaths;
+
+      /// The width and height of a bin of the canvas (in pixels). Photons
+      /// are plotted one bin at a time, so the part of the buffer that
+      /// they touch stays in the cache.
+      static const int binSize = 32;
+
+      /// The number of bins across the width of the canvas.
+      const int binsPerRow;
+
+      /// The number of bins across the height of the canvas.
+      const int binsPerColumn;
+
       /// Constructs a new plot unit that will plot to a canvas
       /// of the specified size.
       PlotUnit(const int width, const int height);
@@ -47,11 +66,52 @@ namespace Luculentus
       /// Plots the result of the specified TraceUnit onto the canvas.
       void Plot(const TraceUnit& traceUnit);
 
-      /// Resets the tristimulus buffer.
+      /// Plots photons that were rendered with the camera and wavelength
+      /// distribution, see PlotPhoton. This is how trace units plot their
+      /// photons themselves.
+      void PlotPhotons(const MappedPhoton* photons, const int count,
+                       const Camera& camera,
+                       const WavelengthDistribution& distribution);
+
+      /// Resets the tristimulus buffer and the number of plotted paths.
       void Clear();
 
     private:
 
+      /// The bin of every photon that is plotted. Photons of light paths
+      /// come after the mapped photons.
+      std::vector<int> photonBins;
+
+      /// The index of the first photon of every bin in binnedPhotons,
+      /// and the end of the last bin.
+      std::vector<int> binStarts;
+
+      /// While sorting, the index in binnedPhotons of the next photon
+      /// of every bin.
+      std::vector<int> binEnds;
+
+      /// The photons to plot, sorted by bin.
+      std::vector<int> binnedPhotons;
+
+      /// Returns the bin of the pixel that the hero wavelength of the
+      /// photon lands on.
+      int GetBin(const MappedPhoton& photon) const;
+
+      /// Returns the bin of the pixel that the hero wavelength of the
+      /// packed photon lands on, or the nearest one if it lands outside
+      /// the screen.
+      int GetBin(const PackedPhoton& photon, const float screenScale) const;
+
+      /// Returns the photon that TraceUnit packed, with the screen scale
+      /// of that trace unit.
+      MappedPhoton Unpack(const PackedPhoton& photon,
+                          const float screenScale) const;
+
+      /// Plots every wavelength of the photon, at the position where the
+      /// lens puts it, weighted by how likely its wavelengths were.
+      void PlotPhoton(const MappedPhoton& photon, const Camera& camera,
+                      const WavelengthDistribution& distribution);
+
       /// Plots a pixel, anti-aliased into the buffer
       /// (adding it to existing content).
       void PlotPixel(float x, float y, Vector3 cie);
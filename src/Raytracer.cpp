@@ -38,10 +38,12 @@ const int Raytracer::numberOfThreads =
 const int Raytracer::numberOfThreads = 1; 
 #endif
 
-Raytracer::Raytracer(UserInterface& ui)
-  : taskScheduler(numberOfThreads, imageWidth, imageHeight, scene)
-  , userInterface(ui)
+Raytracer::Raytracer(UserInterface& ui, const RenderSettings& settings)
+  : userInterface(ui)
   , scene(BuildScene())
+  , compiledScene(scene)
+  , taskScheduler(numberOfThreads, imageWidth, imageHeight, compiledScene,
+                  settings)
 {
 
 }
@@ -109,6 +111,10 @@ void Raytracer::ExecuteTask(const Task task)
     case Task::Plot:    ExecutePlotTask(task);    break;
     case Task::Gather:  ExecuteGatherTask(task);  break;
     case Task::Tonemap: ExecuteTonemapTask(task); break;
+    case Task::Locate:  ExecuteLocateTask(task);  break;
+    case Task::Index:   ExecuteIndexTask(task);   break;
+    case Task::Emit:    ExecuteEmitTask(task);    break;
+    case Task::Update:  ExecuteUpdateTask(task);  break;
   }
 }
 
@@ -121,8 +127,13 @@ void Raytracer::ExecuteSleepTask(const Task)
 
 void Raytracer::ExecuteTraceTask(const Task task)
 {
-  // Let the trace unit do all the work, then the task is done
-  taskScheduler.traceUnits[task.unit].Render();
+  // Let the trace unit do all the work, then the task is done. If it
+  // got a plot unit, it plots its photons as well.
+  auto& traceUnit = taskScheduler.traceUnits[task.unit];
+  if (task.otherUnits.empty())
+    traceUnit.Render();
+  else
+    traceUnit.Render(taskScheduler.plotUnits[task.otherUnits.front()]);
 }
 
 void Raytracer::ExecutePlotTask(Task task)
@@ -157,6 +168,9 @@ void Raytracer::ExecuteGatherTask(Task task)
     // so the data does not get accumulated twice
     plotUnit.Clear();
   }
+
+  // With the new data, the noise can be estimated better
+  taskScheduler.gatherUnit->UpdateTileDensities();
 }
 
 void Raytracer::ExecuteTonemapTask(const Task)
@@ -169,6 +183,32 @@ void Raytracer::ExecuteTonemapTask(const Task)
                              taskScheduler.tonemapUnit->rgbBuffer);
 }
 
+void Raytracer::ExecuteLocateTask(const Task task)
+{
+  // Let the trace unit find the visible points of the band
+  auto& traceUnit = taskScheduler.traceUnits[task.unit];
+  traceUnit.Locate(*taskScheduler.photonMapUnit, task.band);
+}
+
+void Raytracer::ExecuteIndexTask(const Task)
+{
+  // All visible points are known now, so they can be indexed
+  taskScheduler.photonMapUnit->BuildGrid();
+}
+
+void Raytracer::ExecuteEmitTask(const Task task)
+{
+  // Let the trace unit emit photons into the photon map
+  auto& traceUnit = taskScheduler.traceUnits[task.unit];
+  traceUnit.EmitPhotons(*taskScheduler.photonMapUnit);
+}
+
+void Raytracer::ExecuteUpdateTask(const Task)
+{
+  // Add the photons of the iteration to the image in the gather unit
+  taskScheduler.photonMapUnit->Update(*taskScheduler.gatherUnit);
+}
+
 // Begin Huge Monolithic Scene Initialisation Function
 
 Scene Luculentus::BuildScene()
@@ -311,7 +351,7 @@ Scene Luculentus::BuildScene()
       // Get the normal and intersection with the floor
       Ray ray; ray.origin = position; ray.direction = normal;
       Intersection intersection;
-      floorParaboloid->Intersect(ray, intersection);
+      floorParaboloid->Intersect(ray, 0.0f, 1.0e12f, intersection);
       normal = -intersection.normal; // Parabola focus is on the other side of the paraboloid
       position = intersection.position + normal * 2.0f;
     
@@ -333,7 +373,7 @@ Scene Luculentus::BuildScene()
       // Get the normal and intersection with the floor
       Ray ray; ray.origin = position; ray.direction = normal;
       Intersection intersection;
-      floorParaboloid->Intersect(ray, intersection);
+      floorParaboloid->Intersect(ray, 0.0f, 1.0e12f, intersection);
       normal = -intersection.normal; // Parabola focus is on the other side of the paraboloid
       position = intersection.position + normal * 3.0f;
     
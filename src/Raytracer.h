@@ -20,6 +20,8 @@
 #include <thread>
 #include "UserInterface.h"
 #include "Scene.h"
+#include "CompiledScene.h"
+#include "RenderSettings.h"
 #include "TaskScheduler.h"
 
 namespace Luculentus
@@ -29,7 +31,7 @@ namespace Luculentus
     public:
 
       /// Creates a new raytracer
-      Raytracer(UserInterface& ui);
+      Raytracer(UserInterface& ui, const RenderSettings& settings);
 
       /// Starts rendering on separate threads
       void StartRendering();
@@ -61,15 +63,20 @@ namespace Luculentus
       /// The threads that execute the tasks
       std::vector<std::thread> workerThreads;
 
-      /// The TaskScheduler responsible for dividing work across threads.
-      TaskScheduler taskScheduler;
-      
       /// The UI which displays the render result (not owned)
       UserInterface& userInterface;
 
       /// The scene which will be rendered
       Scene scene;
 
+      /// The scene in the form in which it is rendered, compiled from
+      /// the scene
+      CompiledScene compiledScene;
+
+      /// The TaskScheduler responsible for dividing work across threads.
+      /// Its units need the compiled scene when they are constructed.
+      TaskScheduler taskScheduler;
+
       /// Method executed on the main thread
       void RunMain();
 
@@ -94,6 +101,18 @@ namespace Luculentus
 
       /// Executes a 'Tonemap' task, and displays the result in the UI.
       void ExecuteTonemapTask(const Task task);
+
+      /// Executes a 'Locate' task.
+      void ExecuteLocateTask(const Task task);
+
+      /// Executes an 'Index' task.
+      void ExecuteIndexTask(const Task task);
+
+      /// Executes an 'Emit' task.
+      void ExecuteEmitTask(const Task task);
+
+      /// Executes an 'Update' task.
+      void ExecuteUpdateTask(const Task task);
    };
 
   /// Initializes the scene with objects.
@@ -0,0 +1,159 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "RenderSettings.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace Luculentus;
+
+RenderSettings::RenderSettings()
+  : integrator(DepthFirst)
+  , sampler(Sobol)
+  , directLighting(true)
+  , wavelengths(ObserverWavelengths)
+  , roulette(ThroughputRoulette)
+  , minDepth(3)
+  , maxDepth(64)
+  , splitting(false)
+  , adaptiveSampling(true)
+  , fusedPlotting(false)
+{
+
+}
+
+// Parses a number of bounces, which must not be negative. Returns false
+// if the value is not such a number.
+bool ParseDepth(const std::string& value, int& depth)
+{
+  char* end;
+  const long n = std::strtol(value.c_str(), &end, 10);
+  if (value.empty() || *end != '\0' || n < 0 || n > 1 << 16) return false;
+
+  depth = static_cast<int>(n);
+  return true;
+}
+
+RenderSettings Luculentus::ParseRenderSettings(const int argc, char** argv)
+{
+  RenderSettings settings;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string argument = argv[i];
+    const size_t equals = argument.find('=');
+    if (argument.compare(0, 2, "--") != 0 || equals == std::string::npos)
+      continue;
+
+    const std::string name = argument.substr(2, equals - 2);
+    const std::string value = argument.substr(equals + 1);
+
+    if (name == "integrator")
+    {
+      if (value == "depthfirst")
+        settings.integrator = RenderSettings::DepthFirst;
+      else if (value == "wavefront")
+        settings.integrator = RenderSettings::Wavefront;
+      else if (value == "bidirectional")
+        settings.integrator = RenderSettings::Bidirectional;
+      else if (value == "photonmapping")
+        settings.integrator = RenderSettings::ProgressivePhotonMapping;
+      else
+        std::cerr << "Unknown integrator '" << value << "'." << std::endl;
+    }
+    else if (name == "sampler")
+    {
+      if (value == "random")
+        settings.sampler = RenderSettings::Random;
+      else if (value == "sobol")
+        settings.sampler = RenderSettings::Sobol;
+      else if (value == "halton")
+        settings.sampler = RenderSettings::Halton;
+      else
+        std::cerr << "Unknown sampler '" << value << "'." << std::endl;
+    }
+    else if (name == "direct-lighting")
+    {
+      if (value == "on")
+        settings.directLighting = true;
+      else if (value == "off")
+        settings.directLighting = false;
+      else
+        std::cerr << "Unknown direct lighting '" << value << "'." << std::endl;
+    }
+    else if (name == "wavelengths")
+    {
+      if (value == "uniform")
+        settings.wavelengths = RenderSettings::UniformWavelengths;
+      else if (value == "observer")
+        settings.wavelengths = RenderSettings::ObserverWavelengths;
+      else if (value == "lights")
+        settings.wavelengths = RenderSettings::ObserverAndLightWavelengths;
+      else
+        std::cerr << "Unknown wavelengths '" << value << "'." << std::endl;
+    }
+    else if (name == "roulette")
+    {
+      if (value == "heuristic")
+        settings.roulette = RenderSettings::HeuristicRoulette;
+      else if (value == "throughput")
+        settings.roulette = RenderSettings::ThroughputRoulette;
+      else
+        std::cerr << "Unknown roulette '" << value << "'." << std::endl;
+    }
+    else if (name == "min-depth")
+    {
+      if (!ParseDepth(value, settings.minDepth))
+        std::cerr << "Invalid minimum depth '" << value << "'." << std::endl;
+    }
+    else if (name == "max-depth")
+    {
+      if (!ParseDepth(value, settings.maxDepth))
+        std::cerr << "Invalid maximum depth '" << value << "'." << std::endl;
+    }
+    else if (name == "splitting")
+    {
+      if (value == "on")
+        settings.splitting = true;
+      else if (value == "off")
+        settings.splitting = false;
+      else
+        std::cerr << "Unknown splitting '" << value << "'." << std::endl;
+    }
+    else if (name == "adaptive-sampling")
+    {
+      if (value == "on")
+        settings.adaptiveSampling = true;
+      else if (value == "off")
+        settings.adaptiveSampling = false;
+      else
+        std::cerr << "Unknown adaptive sampling '" << value << "'." << std::endl;
+    }
+    else if (name == "fused-plotting")
+    {
+      if (value == "on")
+        settings.fusedPlotting = true;
+      else if (value == "off")
+        settings.fusedPlotting = false;
+      else
+        std::cerr << "Unknown fused plotting '" << value << "'." << std::endl;
+    }
+  }
+
+  return settings;
+}
@@ -0,0 +1,121 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+namespace Luculentus
+{
+  /// Options that control how the image is rendered, which can be set
+  /// on the command line.
+  struct RenderSettings
+  {
+    enum Integrator
+    {
+      /// Trace every path from the camera to its end, before starting
+      /// the next one.
+      DepthFirst,
+      /// Advance a batch of paths by one bounce at a time, grouped by
+      /// material.
+      Wavefront,
+      /// Trace a path from the camera and one from a light, and connect
+      /// every pair of their vertices, combined with multiple importance
+      /// sampling. Finds caustics much sooner.
+      Bidirectional,
+      /// Stochastic progressive photon mapping: find the surfaces that
+      /// the camera sees, and gather the photons that lights send there,
+      /// in a radius that shrinks over time. The only way to find
+      /// caustics that are seen through glass.
+      ProgressivePhotonMapping
+    }
+    /// How the paths of a trace unit are traced.
+    integrator;
+
+    enum SamplerType
+    {
+      /// Independent random numbers.
+      Random,
+      /// The Sobol sequence, Owen-scrambled.
+      Sobol,
+      /// The Halton sequence, with scrambled digits.
+      Halton
+    }
+    /// Where the random numbers for paths are taken from.
+    sampler;
+
+    /// Whether diffuse surfaces sample the lights directly, in addition
+    /// to following a random bounce, combined with multiple importance
+    /// sampling.
+    bool directLighting;
+
+    enum WavelengthSampling
+    {
+      /// Every wavelength is equally likely.
+      UniformWavelengths,
+      /// Proportional to the sensitivity of the observer.
+      ObserverWavelengths,
+      /// Proportional to the sensitivity of the observer, times the
+      /// spectra of the lights in the scene.
+      ObserverAndLightWavelengths
+    }
+    /// How the wavelengths of paths are distributed.
+    wavelengths;
+
+    enum RouletteType
+    {
+      /// The original heuristic: a chance of continuing that falls
+      /// sharply with intensity, and decreases with every bounce. Paths
+      /// that survive are not reweighted, so this is biased.
+      HeuristicRoulette,
+      /// Continue with a chance equal to the throughput of the path,
+      /// and divide the throughput by that chance.
+      ThroughputRoulette
+    }
+    /// How paths are terminated.
+    roulette;
+
+    /// The number of bounces before paths are subject to roulette.
+    /// Heuristic roulette ignores this.
+    int minDepth;
+
+    /// The number of bounces after which paths always end. Heuristic
+    /// roulette ignores this.
+    int maxDepth;
+
+    /// Whether paths with a throughput above one are split into several
+    /// paths that continue independently, each with a part of the
+    /// throughput. This only affects throughput roulette.
+    bool splitting;
+
+    /// Whether camera rays are concentrated in the tiles of the screen
+    /// that are still noisy, rather than spread evenly.
+    bool adaptiveSampling;
+
+    /// Whether trace units plot their photons as soon as a packet is
+    /// traced, into a plot unit of their own, rather than storing all of
+    /// them until a plot unit takes them. This saves the memory of the
+    /// photons, and the time to write them and read them back.
+    bool fusedPlotting;
+
+    /// Creates the default settings.
+    RenderSettings();
+  };
+
+  /// Reads the settings from command-line arguments of the form
+  /// --name=value, for example --integrator=wavefront or
+  /// --direct-lighting=off. Other arguments
+  /// are ignored, they are meant for GTK.
+  RenderSettings ParseRenderSettings(const int argc, char** argv);
+}
@@ -0,0 +1,222 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "Sampler.h"
+
+using namespace Luculentus;
+
+void Sampler::Fill(const std::uint32_t seed, const std::uint32_t index,
+                   const std::uint32_t dimension, float* values,
+                   const int count) const
+{
+  for (int i = 0; i < count; i++)
+  {
+    values[i] = GetSample(seed, index, dimension + i);
+  }
+}
+
+// --------------------
+
+float RandomSampler::GetSample(const std::uint32_t seed,
+                               const std::uint32_t index,
+                               const std::uint32_t dimension) const
+{
+  // Every dimension is the hash of the key of the point, which depends
+  // on the seed and the index in an unrelated way
+  const std::uint32_t key = Hash(seed ^ Hash(index));
+  return ToUnit(Hash(dimension ^ key));
+}
+
+void RandomSampler::Fill(const std::uint32_t seed, const std::uint32_t index,
+                         const std::uint32_t dimension, float* values,
+                         const int count) const
+{
+  // The key is the same for all dimensions, so it is hashed only once
+  const std::uint32_t key = Hash(seed ^ Hash(index));
+  for (int i = 0; i < count; i++)
+    values[i] = ToUnit(Hash((dimension + i) ^ key));
+}
+
+// --------------------
+
+std::uint32_t ReverseBits(std::uint32_t x)
+{
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// A random permutation of the integers in which every bit only depends
+// on the bits below it, by Laine and Karras.
+std::uint32_t LaineKarrasPermutation(std::uint32_t x, const std::uint32_t seed)
+{
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return x;
+}
+
+// Owen scrambling: every bit is flipped depending on the bits above it.
+std::uint32_t NestedUniformScramble(std::uint32_t x, const std::uint32_t seed)
+{
+  return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+SobolSampler::SobolSampler()
+{
+  // The generator matrices, one column per bit of the index
+  std::uint32_t directions[4][32];
+
+  // The first dimension is the van der Corput sequence
+  for (int i = 0; i < 32; i++) directions[0][i] = 1u << (31 - i);
+
+  // The others are defined by a primitive polynomial of degree s with
+  // coefficients a, and initial direction numbers m (from the tables of
+  // Joe and Kuo)
+  const int degrees[3] = { 1, 2, 3 };
+  const std::uint32_t coefficients[3] = { 0, 1, 1 };
+  const std::uint32_t initial[3][3] = { { 1 }, { 1, 3 }, { 1, 3, 1 } };
+
+  for (int d = 1; d < 4; d++)
+  {
+    const int s = degrees[d - 1];
+    const std::uint32_t a = coefficients[d - 1];
+    std::uint32_t m[32];
+
+    for (int i = 0; i < s; i++) m[i] = initial[d - 1][i];
+    for (int i = s; i < 32; i++)
+    {
+      m[i] = m[i - s] ^ (m[i - s] << s);
+      for (int k = 1; k < s; k++)
+      {
+        m[i] ^= ((a >> (s - 1 - k)) & 1u) * (m[i - k] << k);
+      }
+    }
+
+    for (int i = 0; i < 32; i++) directions[d][i] = m[i] << (31 - i);
+  }
+
+  // Tabulate the matrix products per byte of the index, so a product
+  // takes four lookups
+  for (int d = 0; d < 4; d++)
+  for (int b = 0; b < 4; b++)
+  for (std::uint32_t byte = 0; byte < 256; byte++)
+  {
+    std::uint32_t x = 0;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      if (byte & (1u << bit)) x ^= directions[d][b * 8 + bit];
+    }
+    products[d][b][byte] = x;
+  }
+}
+
+// Shuffles the points differently for every group of four dimensions, so
+// the groups are decorrelated.
+std::uint32_t ShuffleSobol(const std::uint32_t seed, const std::uint32_t index,
+                           const std::uint32_t group)
+{
+  return NestedUniformScramble(index, Sampler::Hash(seed
+                                      ^ Sampler::Hash(group)));
+}
+
+float SobolSampler::GetScrambledSobol(const std::uint32_t seed,
+                                      const std::uint32_t shuffledIndex,
+                                      const std::uint32_t dimension) const
+{
+  // Multiply the generator matrix by the index, one byte at a time
+  const std::uint32_t (&p)[4][256] = products[dimension % 4];
+  const std::uint32_t x = p[0][shuffledIndex & 0xff]
+                        ^ p[1][(shuffledIndex >> 8) & 0xff]
+                        ^ p[2][(shuffledIndex >> 16) & 0xff]
+                        ^ p[3][shuffledIndex >> 24];
+
+  return ToUnit(NestedUniformScramble(x, Hash(seed + Hash(dimension + 1))));
+}
+
+float SobolSampler::GetSample(const std::uint32_t seed,
+                              const std::uint32_t index,
+                              const std::uint32_t dimension) const
+{
+  return GetScrambledSobol(seed, ShuffleSobol(seed, index, dimension / 4),
+                           dimension);
+}
+
+void SobolSampler::Fill(const std::uint32_t seed, const std::uint32_t index,
+                        const std::uint32_t dimension, float* values,
+                        const int count) const
+{
+  std::uint32_t group = dimension / 4;
+  std::uint32_t shuffledIndex = ShuffleSobol(seed, index, group);
+
+  for (int i = 0; i < count; i++)
+  {
+    const std::uint32_t d = dimension + i;
+    if (d / 4 != group)
+    {
+      group = d / 4;
+      shuffledIndex = ShuffleSobol(seed, index, group);
+    }
+    values[i] = GetScrambledSobol(seed, shuffledIndex, d);
+  }
+}
+
+// --------------------
+
+namespace
+{
+  const std::uint32_t primes[HaltonSampler::numberOfBases] =
+  {
+      2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,
+     47,  53,  59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107,
+    109, 113, 127, 131
+  };
+}
+
+float HaltonSampler::GetSample(const std::uint32_t seed,
+                               const std::uint32_t index,
+                               const std::uint32_t dimension) const
+{
+  const std::uint32_t base = primes[dimension % numberOfBases];
+  const std::uint32_t round = dimension / numberOfBases;
+  const std::uint32_t digitSeed = Hash(seed + Hash(dimension));
+
+  // Later rounds through the bases visit the points in another order
+  std::uint32_t i = round == 0 ? index
+    : NestedUniformScramble(index, Hash(seed ^ Hash(round)));
+
+  // Compute the radical inverse, shifting every digit. Also shift the
+  // digits after the last nonzero one, until they no longer matter.
+  const float inverseBase = 1.0f / static_cast<float>(base);
+  float factor = inverseBase;
+  float x = 0.0f;
+
+  for (std::uint32_t k = 0; factor > 1.0e-7f; k++)
+  {
+    const std::uint32_t shift = Hash(digitSeed + k) % base;
+    const std::uint32_t digit = (i % base + shift) % base;
+    x += static_cast<float>(digit) * factor;
+    factor *= inverseBase;
+    i /= base;
+  }
+
+  // Rounding might reach 1 exactly
+  return x < 1.0f ? x : 0.99999994f;
+}
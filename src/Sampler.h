@@ -0,0 +1,127 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+
+namespace Luculentus
+{
+  /// A source of sample values in the range 0 .. 1. A sampler generates
+  /// a sequence of points, which have a value for every dimension, and
+  /// points can be generated in any order. Different seeds give
+  /// independent sequences.
+  class Sampler
+  {
+    public:
+
+      virtual ~Sampler() { }
+
+      /// Returns the value of the point with the specified index in the
+      /// sequence for the seed, in the specified dimension.
+      virtual float GetSample(const std::uint32_t seed,
+                              const std::uint32_t index,
+                              const std::uint32_t dimension) const = 0;
+
+      /// Stores the values of the point in count consecutive dimensions,
+      /// starting at the specified dimension.
+      virtual void Fill(const std::uint32_t seed, const std::uint32_t index,
+                        const std::uint32_t dimension, float* values,
+                        const int count) const;
+
+      /// A bijective integer hash with good avalanche behaviour (the
+      /// 'triple32' hash by Chris Wellons).
+      static inline std::uint32_t Hash(std::uint32_t x)
+      {
+        x ^= x >> 17; x *= 0xed5ad4bbu;
+        x ^= x >> 11; x *= 0xac4c1b51u;
+        x ^= x >> 15; x *= 0x31848babu;
+        x ^= x >> 14;
+        return x;
+      }
+
+    protected:
+
+      /// Converts the upper 24 bits to a real in the range 0 .. 1.
+      static inline float ToUnit(const std::uint32_t x)
+      { return static_cast<float>(x >> 8) * (1.0f / 16777216.0f); }
+  };
+
+  /// Independent uniform random values for every point and dimension.
+  class RandomSampler : public Sampler
+  {
+    public:
+
+      virtual float GetSample(const std::uint32_t seed,
+                              const std::uint32_t index,
+                              const std::uint32_t dimension) const;
+
+      /// Hashes the key of the point only once.
+      virtual void Fill(const std::uint32_t seed, const std::uint32_t index,
+                        const std::uint32_t dimension, float* values,
+                        const int count) const;
+  };
+
+  /// The Sobol sequence with hash-based Owen scrambling, after Burley,
+  /// "Practical Hash-based Owen Scrambling" (2020). Only the first four
+  /// dimensions of the Sobol sequence are used; every further group of
+  /// four dimensions uses them again, with the points in a differently
+  /// scrambled order.
+  class SobolSampler : public Sampler
+  {
+    public:
+
+      SobolSampler();
+
+      virtual float GetSample(const std::uint32_t seed,
+                              const std::uint32_t index,
+                              const std::uint32_t dimension) const;
+
+      /// Shuffles the points once for every group of four dimensions.
+      virtual void Fill(const std::uint32_t seed, const std::uint32_t index,
+                        const std::uint32_t dimension, float* values,
+                        const int count) const;
+
+    private:
+
+      /// Returns the scrambled value of the point with the (shuffled)
+      /// index in the dimension.
+      float GetScrambledSobol(const std::uint32_t seed,
+                              const std::uint32_t shuffledIndex,
+                              const std::uint32_t dimension) const;
+
+      /// The products of the generator matrices of the four dimensions
+      /// with every byte of the index, for each of the four bytes.
+      std::uint32_t products[4][4][256];
+  };
+
+  /// The Halton sequence with random digit scrambling: in every
+  /// dimension, digit k of the radical inverse is shifted by an amount
+  /// that depends on the seed, the dimension and k. Dimensions beyond
+  /// the number of prime bases use the bases again, with the points in
+  /// a differently scrambled order.
+  class HaltonSampler : public Sampler
+  {
+    public:
+
+      virtual float GetSample(const std::uint32_t seed,
+                              const std::uint32_t index,
+                              const std::uint32_t dimension) const;
+
+      /// The number of prime bases, one per dimension.
+      static const int numberOfBases = 32;
+  };
+}
@@ -36,9 +36,5 @@ namespace Luculentus
       /// the range 0.0  1.0), which will be sampled randomly to create
       /// effects like motion blur and zoom blur.
       std::function<Camera (const float)> GetCameraAtTime;
-
-      /// Intersects the specified ray with the scene. If an object is
-      /// intersected, it is returned, and the intersection is set.
-      const Object* Intersect(Ray ray, Intersection& intersection) const;
   };
 }
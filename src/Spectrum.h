@@ -0,0 +1,87 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+namespace Luculentus
+{
+  /// A value for every wavelength that a path carries. The first lane is
+  /// the hero wavelength, which determines the path. The others follow
+  /// from it, see WavelengthDistribution::GetWavelengths.
+  struct Spectrum
+  {
+    /// The number of wavelengths per path.
+    static const int size = 4;
+
+    float values[size];
+
+    inline float& operator[](const int lane) { return values[lane]; }
+
+    inline float operator[](const int lane) const { return values[lane]; }
+  };
+
+  /// Returns a spectrum with the same value in every lane.
+  inline Spectrum MakeSpectrum(const float value)
+  {
+    Spectrum s;
+    for (int i = 0; i < Spectrum::size; i++) s[i] = value;
+    return s;
+  }
+
+  inline Spectrum operator+(const Spectrum a, const Spectrum b)
+  {
+    Spectrum sum;
+    for (int i = 0; i < Spectrum::size; i++) sum[i] = a[i] + b[i];
+    return sum;
+  }
+
+  inline Spectrum operator+=(Spectrum& a, const Spectrum b)
+  {
+    return a = a + b;
+  }
+
+  inline Spectrum operator*(const Spectrum a, const Spectrum b)
+  {
+    Spectrum prod;
+    for (int i = 0; i < Spectrum::size; i++) prod[i] = a[i] * b[i];
+    return prod;
+  }
+
+  inline Spectrum operator*=(Spectrum& a, const Spectrum b)
+  {
+    return a = a * b;
+  }
+
+  inline Spectrum operator*(const Spectrum a, const float f)
+  {
+    Spectrum prod;
+    for (int i = 0; i < Spectrum::size; i++) prod[i] = a[i] * f;
+    return prod;
+  }
+
+  inline Spectrum operator*(const float f, const Spectrum a)
+  {
+    return a * f;
+  }
+
+  /// Returns the average over the lanes.
+  inline float GetAverage(const Spectrum a)
+  {
+    float sum = 0.0f;
+    for (int i = 0; i < Spectrum::size; i++) sum += a[i];
+    return sum / Spectrum::size;
+  }
+}
@@ -0,0 +1,248 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "SpherePool.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+using namespace Luculentus;
+
+SpherePool::SpherePool()
+{
+  Clear();
+  Finish();
+}
+
+void SpherePool::Clear()
+{
+  centreX.clear();
+  centreY.clear();
+  centreZ.clear();
+  radiusSquared.clear();
+}
+
+void SpherePool::Add(const Vector3 centre, const float sphereRadiusSquared)
+{
+  centreX.push_back(centre.x);
+  centreY.push_back(centre.y);
+  centreZ.push_back(centre.z);
+  radiusSquared.push_back(sphereRadiusSquared);
+}
+
+void SpherePool::AddEmpty()
+{
+  Add(ZeroVector3(), -1.0f);
+}
+
+void SpherePool::Finish()
+{
+  for (int i = 0; i < width; i++) AddEmpty();
+}
+
+bool SpherePool::IntersectNearest(const Ray ray, const int begin,
+                                  const int end, const float tMin,
+                                  float& tMax, int& index) const
+{
+  // For a ray with normalised direction d and a sphere at offset c from
+  // the ray origin, the point nearest to the centre lies at t = h with
+  // h = d.c, at offset p = c - h d from the centre. The ray enters the
+  // sphere at t = h - sqrt(r^2 - p.p), if r^2 - p.p is positive. Like
+  // Sphere, only the first of the two intersections counts. For an
+  // empty slot, r^2 is negative, so the ray never enters.
+  const float maxDistance = tMax;
+  float distances[width];
+  int indices[width];
+
+#if defined(__AVX512F__)
+  const __m512 ox = _mm512_set1_ps(ray.origin.x);
+  const __m512 oy = _mm512_set1_ps(ray.origin.y);
+  const __m512 oz = _mm512_set1_ps(ray.origin.z);
+  const __m512 dx = _mm512_set1_ps(ray.direction.x);
+  const __m512 dy = _mm512_set1_ps(ray.direction.y);
+  const __m512 dz = _mm512_set1_ps(ray.direction.z);
+  const __m512 minT = _mm512_set1_ps(tMin);
+  const __m512i last = _mm512_set1_epi32(end);
+  const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                          8, 9, 10, 11, 12, 13, 14, 15);
+
+  __m512 best = _mm512_set1_ps(maxDistance);
+  __m512i bestIndex = _mm512_set1_epi32(-1);
+
+  for (int i = begin; i < end; i += width)
+  {
+    const __m512 cx = _mm512_sub_ps(_mm512_loadu_ps(&centreX[i]), ox);
+    const __m512 cy = _mm512_sub_ps(_mm512_loadu_ps(&centreY[i]), oy);
+    const __m512 cz = _mm512_sub_ps(_mm512_loadu_ps(&centreZ[i]), oz);
+    const __m512 r2 = _mm512_loadu_ps(&radiusSquared[i]);
+
+    const __m512 h = _mm512_fmadd_ps(dx, cx,
+                     _mm512_fmadd_ps(dy, cy, _mm512_mul_ps(dz, cz)));
+    const __m512 px = _mm512_fnmadd_ps(h, dx, cx);
+    const __m512 py = _mm512_fnmadd_ps(h, dy, cy);
+    const __m512 pz = _mm512_fnmadd_ps(h, dz, cz);
+    const __m512 discriminant = _mm512_sub_ps(r2, _mm512_fmadd_ps(px, px,
+                                _mm512_fmadd_ps(py, py, _mm512_mul_ps(pz, pz))));
+    const __m512 t = _mm512_sub_ps(h, _mm512_sqrt_ps(
+                     _mm512_max_ps(discriminant, _mm512_setzero_ps())));
+
+    // Lanes past the end belong to other leaves
+    const __m512i position = _mm512_add_epi32(_mm512_set1_epi32(i), lanes);
+    const __mmask16 hit =
+      _mm512_cmp_ps_mask(discriminant, _mm512_setzero_ps(), _CMP_GT_OQ)
+      & _mm512_cmp_ps_mask(t, minT, _CMP_GT_OQ)
+      & _mm512_cmp_ps_mask(t, best, _CMP_LT_OQ)
+      & _mm512_cmplt_epi32_mask(position, last);
+
+    best = _mm512_mask_blend_ps(hit, best, t);
+    bestIndex = _mm512_mask_blend_epi32(hit, bestIndex, position);
+  }
+
+  _mm512_storeu_ps(distances, best);
+  _mm512_storeu_si512(indices, bestIndex);
+#elif defined(__AVX2__)
+  const __m256 ox = _mm256_set1_ps(ray.origin.x);
+  const __m256 oy = _mm256_set1_ps(ray.origin.y);
+  const __m256 oz = _mm256_set1_ps(ray.origin.z);
+  const __m256 dx = _mm256_set1_ps(ray.direction.x);
+  const __m256 dy = _mm256_set1_ps(ray.direction.y);
+  const __m256 dz = _mm256_set1_ps(ray.direction.z);
+  const __m256 minT = _mm256_set1_ps(tMin);
+  const __m256i last = _mm256_set1_epi32(end);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  __m256 best = _mm256_set1_ps(maxDistance);
+  __m256i bestIndex = _mm256_set1_epi32(-1);
+
+  for (int i = begin; i < end; i += width)
+  {
+    const __m256 cx = _mm256_sub_ps(_mm256_loadu_ps(&centreX[i]), ox);
+    const __m256 cy = _mm256_sub_ps(_mm256_loadu_ps(&centreY[i]), oy);
+    const __m256 cz = _mm256_sub_ps(_mm256_loadu_ps(&centreZ[i]), oz);
+    const __m256 r2 = _mm256_loadu_ps(&radiusSquared[i]);
+
+    const __m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, cx),
+                     _mm256_mul_ps(dy, cy)), _mm256_mul_ps(dz, cz));
+    const __m256 px = _mm256_sub_ps(cx, _mm256_mul_ps(h, dx));
+    const __m256 py = _mm256_sub_ps(cy, _mm256_mul_ps(h, dy));
+    const __m256 pz = _mm256_sub_ps(cz, _mm256_mul_ps(h, dz));
+    const __m256 discriminant = _mm256_sub_ps(r2, _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)),
+      _mm256_mul_ps(pz, pz)));
+    const __m256 t = _mm256_sub_ps(h, _mm256_sqrt_ps(
+                     _mm256_max_ps(discriminant, _mm256_setzero_ps())));
+
+    // Lanes past the end belong to other leaves
+    const __m256i position = _mm256_add_epi32(_mm256_set1_epi32(i), lanes);
+    const __m256 hit = _mm256_and_ps(_mm256_and_ps(
+      _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GT_OQ),
+      _mm256_cmp_ps(t, minT, _CMP_GT_OQ)), _mm256_and_ps(
+      _mm256_cmp_ps(t, best, _CMP_LT_OQ),
+      _mm256_castsi256_ps(_mm256_cmpgt_epi32(last, position))));
+
+    best = _mm256_blendv_ps(best, t, hit);
+    bestIndex = _mm256_castps_si256(_mm256_blendv_ps(
+      _mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(position), hit));
+  }
+
+  _mm256_storeu_ps(distances, best);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(indices), bestIndex);
+#elif defined(__SSE2__) || defined(_M_X64)
+  const __m128 ox = _mm_set1_ps(ray.origin.x);
+  const __m128 oy = _mm_set1_ps(ray.origin.y);
+  const __m128 oz = _mm_set1_ps(ray.origin.z);
+  const __m128 dx = _mm_set1_ps(ray.direction.x);
+  const __m128 dy = _mm_set1_ps(ray.direction.y);
+  const __m128 dz = _mm_set1_ps(ray.direction.z);
+  const __m128 minT = _mm_set1_ps(tMin);
+  const __m128i last = _mm_set1_epi32(end);
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+
+  __m128 best = _mm_set1_ps(maxDistance);
+  __m128i bestIndex = _mm_set1_epi32(-1);
+
+  for (int i = begin; i < end; i += width)
+  {
+    const __m128 cx = _mm_sub_ps(_mm_loadu_ps(&centreX[i]), ox);
+    const __m128 cy = _mm_sub_ps(_mm_loadu_ps(&centreY[i]), oy);
+    const __m128 cz = _mm_sub_ps(_mm_loadu_ps(&centreZ[i]), oz);
+    const __m128 r2 = _mm_loadu_ps(&radiusSquared[i]);
+
+    const __m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, cx),
+                     _mm_mul_ps(dy, cy)), _mm_mul_ps(dz, cz));
+    const __m128 px = _mm_sub_ps(cx, _mm_mul_ps(h, dx));
+    const __m128 py = _mm_sub_ps(cy, _mm_mul_ps(h, dy));
+    const __m128 pz = _mm_sub_ps(cz, _mm_mul_ps(h, dz));
+    const __m128 discriminant = _mm_sub_ps(r2, _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz)));
+    const __m128 t = _mm_sub_ps(h, _mm_sqrt_ps(
+                     _mm_max_ps(discriminant, _mm_setzero_ps())));
+
+    // Lanes past the end belong to other leaves
+    const __m128i position = _mm_add_epi32(_mm_set1_epi32(i), lanes);
+    const __m128 hit = _mm_and_ps(_mm_and_ps(
+      _mm_cmpgt_ps(discriminant, _mm_setzero_ps()), _mm_cmpgt_ps(t, minT)),
+      _mm_and_ps(_mm_cmplt_ps(t, best),
+                 _mm_castsi128_ps(_mm_cmplt_epi32(position, last))));
+
+    best = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, best));
+    const __m128i hitMask = _mm_castps_si128(hit);
+    bestIndex = _mm_or_si128(_mm_and_si128(hitMask, position),
+                             _mm_andnot_si128(hitMask, bestIndex));
+  }
+
+  _mm_storeu_ps(distances, best);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), bestIndex);
+#else
+  for (int j = 0; j < width; j++)
+  {
+    distances[j] = maxDistance;
+    indices[j] = -1;
+  }
+
+  for (int i = begin; i < end; i++)
+  {
+    const Vector3 c = MakeVector3(centreX[i], centreY[i], centreZ[i])
+                    - ray.origin;
+    const float h = Dot(ray.direction, c);
+    const Vector3 p = c - h * ray.direction;
+    const float discriminant = radiusSquared[i] - Dot(p, p);
+    if (discriminant <= 0.0f) continue;
+
+    const float t = h - std::sqrt(discriminant);
+    if (t > tMin && t < distances[0])
+    {
+      distances[0] = t;
+      indices[0] = i;
+    }
+  }
+#endif
+
+  // Finally pick the nearest of the lanes
+  bool hit = false;
+  for (int j = 0; j < width; j++)
+  {
+    if (indices[j] != -1 && distances[j] < tMax)
+    {
+      tMax = distances[j];
+      index = indices[j];
+      hit = true;
+    }
+  }
+
+  return hit;
+}
@@ -0,0 +1,83 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+#include "Ray.h"
+
+namespace Luculentus
+{
+  /// A set of spheres stored per component, so that a ray can be tested
+  /// against multiple spheres with one vector instruction.
+  class SpherePool
+  {
+    public:
+
+      /// The number of spheres tested at once.
+      #if defined(__AVX512F__)
+      static const int width = 16;
+      #elif defined(__AVX2__)
+      static const int width = 8;
+      #else
+      static const int width = 4;
+      #endif
+
+      /// The components of the sphere centres.
+      std::vector<float> centreX, centreY, centreZ;
+
+      /// The radii of the spheres, squared. Empty slots have a negative
+      /// squared radius, which no ray can intersect.
+      std::vector<float> radiusSquared;
+
+      /// Creates an empty pool that is ready to be intersected.
+      SpherePool();
+
+      /// Removes all spheres. Call Finish after adding the new ones.
+      void Clear();
+
+      /// Appends a sphere.
+      void Add(const Vector3 centre, const float sphereRadiusSquared);
+
+      /// Appends a slot that is never intersected.
+      void AddEmpty();
+
+      /// Ends the arrays with a number of empty slots, so that loading a
+      /// vector past the last sphere stays within the arrays. This must
+      /// be done after the last sphere was added, before intersecting.
+      void Finish();
+
+      /// Returns the number of spheres and empty slots.
+      inline int GetSize() const
+      {
+        return static_cast<int>(radiusSquared.size()) - width;
+      }
+
+      /// Returns whether the slot at the position holds no sphere.
+      inline bool IsEmpty(const int position) const
+      {
+        return radiusSquared[position] < 0.0f;
+      }
+
+      /// Intersects the ray with the spheres at positions begin up to
+      /// end, in the same way as Sphere does. If a sphere is hit between
+      /// tMin and tMax, tMax is set to the distance of the nearest hit,
+      /// its position is stored in index, and true is returned.
+      bool IntersectNearest(const Ray ray, const int begin, const int end,
+                            const float tMin, float& tMax,
+                            int& index) const;
+  };
+}
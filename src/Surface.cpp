@@ -20,6 +20,25 @@
 
 using namespace Luculentus;
 
+bool Surface::Intersect(const Ray ray, const float tMin, const float tMax,
+                        Intersection& intersection) const
+{
+  float distance;
+  int part;
+  if (!IntersectDistance(ray, tMin, tMax, distance, part)) return false;
+
+  GetAttributes(ray, distance, part, intersection);
+  return true;
+}
+
+bool Surface::GetBoundingBox(BoundingBox&) const
+{
+  // Unless a surface knows better, it is assumed to be unbounded
+  return false;
+}
+
+// --------------------
+
 Plane::Plane(const Vector3 n, const Vector3 o)
   : normal(n)
   , offset(o) { }
@@ -28,7 +47,9 @@ Plane::Plane(const Plane& other)
   : normal(other.normal)
   , offset(other.offset) { }
 
-bool Plane::Intersect(const Ray ray, Intersection& intersection) const
+bool Plane::IntersectDistance(const Ray ray,
+                              const float tMin, const float tMax,
+                              float& distance, int& part) const
 {
   // Transform the ray into the space where the plane is a linear
   // subspace (a plane through the origin)
@@ -36,17 +57,23 @@ bool Plane::Intersect(const Ray ray, Intersection& intersection) const
 
   float t = - Dot(normal, localOrigin) / Dot(normal, ray.direction);
 
-  // A ray has one direction only, do not hit backwards
-  if (t <= 0.0f) return false;
+  // A ray has one direction only, do not hit backwards, and do not hit
+  // beyond the range of interest
+  if (t <= tMin || t >= tMax) return false;
 
-  // Fill in the intersection details
-  intersection.distance = t;
+  distance = t;
+  part = 0;
+  return true;
+}
+
+void Plane::GetAttributes(const Ray ray, const float distance, const int,
+                          Intersection& intersection) const
+{
+  intersection.distance = distance;
   float sign = Dot(normal, ray.direction);
   // Planes are two-sided
   intersection.normal = sign < 0.0f ? normal : -normal;
-  intersection.position = ray.origin + t * ray.direction;
-
-  return true;
+  intersection.position = ray.origin + distance * ray.direction;
 }
 
 // --------------------
@@ -57,24 +84,24 @@ SpacePartitioning::SpacePartitioning(const Vector3 n, const Vector3 o)
 SpacePartitioning::SpacePartitioning(const SpacePartitioning& other)
   : Plane(other) { }
 
-bool SpacePartitioning::Intersect(const Ray ray,
-                                  Intersection& intersection) const
+bool SpacePartitioning::IntersectDistance(const Ray ray,
+                                          const float tMin,
+                                          const float tMax,
+                                          float& distance,
+                                          int& part) const
 {
-  // Transform the ray into the space where the plane is a linear
-  // subspace (a plane through the origin)
-  Vector3 localOrigin = ray.origin - offset;
-
-  float t = - Dot(normal, localOrigin) / Dot(normal, ray.direction);
-
-  // A ray has one direction only, do not hit backwards
-  if (t <= 0.0f) return false;
+  // The intersection is the same as for a plane, only the normal
+  // differs
+  return Plane::IntersectDistance(ray, tMin, tMax, distance, part);
+}
 
-  // Fill in the intersection details
-  intersection.distance = t;
+void SpacePartitioning::GetAttributes(const Ray ray, const float distance,
+                                      const int,
+                                      Intersection& intersection) const
+{
+  intersection.distance = distance;
   intersection.normal = normal; // A space partitioning is one-sided
-  intersection.position = ray.origin + t * ray.direction;
-
-  return true;
+  intersection.position = ray.origin + distance * ray.direction;
 }
 
 bool SpacePartitioning::LiesInside(const Vector3 x) const
@@ -94,19 +121,37 @@ Circle::Circle(const Circle& other)
   , radiusSquared(other.radiusSquared)
   , radius(other.radius) { }
 
-bool Circle::Intersect(const Ray ray, Intersection& intersection) const
+bool Circle::IntersectDistance(const Ray ray,
+                               const float tMin, const float tMax,
+                               float& distance, int& part) const
 {
   // If the ray intersects the plane in which the circle lies
-  if (Plane::Intersect(ray, intersection))
+  if (Plane::IntersectDistance(ray, tMin, tMax, distance, part))
   {
     // Then the intersection must lie within the circle
-    return (intersection.position - offset)
-      .MagnitudeSquared() <= radiusSquared;
+    const Vector3 position = ray.origin + distance * ray.direction;
+    return (position - offset).MagnitudeSquared() <= radiusSquared;
   }
 
   return false;
 }
 
+bool Circle::GetBoundingBox(BoundingBox& box) const
+{
+  // The extent of the disk along an axis depends on how much the plane
+  // is tilted with respect to that axis
+  const Vector3 extent =
+  {
+    radius * std::sqrt(std::fmax(0.0f, 1.0f - normal.x * normal.x)),
+    radius * std::sqrt(std::fmax(0.0f, 1.0f - normal.y * normal.y)),
+    radius * std::sqrt(std::fmax(0.0f, 1.0f - normal.z * normal.z))
+  };
+
+  box.min = offset - extent;
+  box.max = offset + extent;
+  return true;
+}
+
 // --------------------
 
 Sphere::Sphere(const Vector3 p, const float r)
@@ -117,7 +162,9 @@ Sphere::Sphere(const Sphere& other)
   : position(other.position)
   , radiusSquared(other.radiusSquared) { }
 
-bool Sphere::Intersect(const Ray ray, Intersection& intersection) const
+bool Sphere::IntersectDistance(const Ray ray,
+                               const float tMin, const float tMax,
+                               float& distance, int& part) const
 {
   float t1, t2;
   
@@ -128,15 +175,25 @@ bool Sphere::Intersect(const Ray ray, Intersection& intersection) const
   float t = 0.0f;
 
   // One of the ts must be positive at least
-  if (t1 > 0.0f && t1 < t2) t = t1;
-  else if (t2 > 0.0f && t2 < t1) t = t2;
+  if (t1 > tMin && t1 < t2) t = t1;
+  else if (t2 > tMin && t2 < t1) t = t2;
   // For negative t, the spehere lies behind the ray entirely
   else return false;
 
+  if (t >= tMax) return false;
+
+  distance = t;
+  part = 0;
+  return true;
+}
+
+void Sphere::GetAttributes(const Ray ray, const float distance, const int,
+                           Intersection& intersection) const
+{
   // Distance is equal to t, and the intersection can be calculated
   // from here
-  intersection.position = ray.direction * t + ray.origin;
-  intersection.distance = t;
+  intersection.position = ray.direction * distance + ray.origin;
+  intersection.distance = distance;
 
   // The normal points radially outward everywhere
   intersection.normal = intersection.position - position;
@@ -147,9 +204,6 @@ bool Sphere::Intersect(const Ray ray, Intersection& intersection) const
   Vector3 up = { 0.0f, 1.0f, 0.0f };
   intersection.tangent = Cross(up, intersection.normal);
   intersection.tangent.Normalise();
-
-  // The intersection has been found now
-  return true;
 }
 
 bool Sphere::LiesInside(const Vector3 x) const
@@ -157,28 +211,40 @@ bool Sphere::LiesInside(const Vector3 x) const
   return (x - position).MagnitudeSquared() < radiusSquared;
 }
 
+bool Sphere::GetBoundingBox(BoundingBox& box) const
+{
+  const float radius = std::sqrt(radiusSquared);
+  const Vector3 extent = { radius, radius, radius };
+  box.min = position - extent;
+  box.max = position + extent;
+  return true;
+}
+
 bool Sphere::GetIntersections(const Vector3 spherePosition,
                               const float sphereRadiusSquared,
                               const Vector3 rayOrigin,
                               const Vector3 rayDirection,
                               float& t1, float& t2)
 {
-  // Compute a, b, c factors of the quadratic equation
-  const float a = 1.0f;
+  // Find the point on the ray nearest to the centre. (The direction is
+  // normalised, so the quadratic equation has a = 1.)
   const Vector3 centreOffset = spherePosition - rayOrigin;
-  const float b = 2.0f * Dot(rayDirection, centreOffset);
-  const float c = centreOffset.MagnitudeSquared() - sphereRadiusSquared;
+  const float h = Dot(rayDirection, centreOffset);
+  const Vector3 perpendicular = centreOffset - h * rayDirection;
 
-  // The discriminant determines whether the equation has a solution
-  const float discriminant = b * b - 4.0f * a * c;
+  // The discriminant determines whether the equation has a solution.
+  // Computing it from the distance to the nearest point, rather than as
+  // b^2 - 4ac, avoids cancellation for distant spheres.
+  const float discriminant = sphereRadiusSquared
+                           - perpendicular.MagnitudeSquared();
 
   // If it less than zero, there is no intersection
   if (discriminant < 0.0f) return false;
 
   // Otherwise, the equation can be solved for t.
   const float sqrtD = std::sqrt(discriminant);
-  t1 = -0.5f * (-b + sqrtD) / a;
-  t2 = -0.5f * (-b - sqrtD) / a;
+  t1 = h - sqrtD;
+  t2 = h + sqrtD;
 
   return true;
 }
@@ -196,7 +262,9 @@ Paraboloid::Paraboloid(const Paraboloid& other)
   , normal(other.normal)
   , focalPoint(other.focalPoint) { }
 
-bool Paraboloid::Intersect(const Ray ray, Intersection& intersection) const
+bool Paraboloid::IntersectDistance(const Ray ray,
+                                   const float tMin, const float tMax,
+                                   float& distance, int& part) const
 {
   float t;
 
@@ -219,7 +287,7 @@ bool Paraboloid::Intersect(const Ray ray, Intersection& intersection) const
   {
     t = -c / b;
     // For negative t, the paraboloid lies behind the ray
-    if (t < 0.0f) return false;
+    if (t < tMin) return false;
   }
   else
   {
@@ -229,21 +297,35 @@ bool Paraboloid::Intersect(const Ray ray, Intersection& intersection) const
     // If it less than zero, there is no intersection
     if (discriminant < 0.0f) return false;
 
-    // Otherwise, the equation can be solved for t.
+    // Otherwise, the equation can be solved for t. The root near zero
+    // is computed as c / q, because -b + sqrtD cancels badly when the
+    // ray starts on the paraboloid.
     const float sqrtD = std::sqrt(discriminant);
-    const float t1 = 0.5f * (-b + sqrtD) / a;
-    const float t2 = 0.5f * (-b - sqrtD) / a;
+    const float q = -0.5f * (b + std::copysign(sqrtD, b));
+    const float t1 = q / a;
+    const float t2 = c / q;
 
     // Pick the closest non-negative t
-    if (t1 > 0.0f && (t1 < t2 || t2 <= 0.0f)) t = t1;
-    else if (t2 > 0.0f) t = t2;
+    if (t1 > tMin && (t1 < t2 || t2 <= tMin)) t = t1;
+    else if (t2 > tMin) t = t2;
     // For negative t, the paraboloid lies behind the ray entirely
     else return false;
   }
 
+  if (t >= tMax) return false;
+
+  distance = t;
+  part = 0;
+  return true;
+}
+
+void Paraboloid::GetAttributes(const Ray ray, const float distance,
+                               const int,
+                               Intersection& intersection) const
+{
   // Fill in the intersection details
-  intersection.distance = t;
-  intersection.position = ray.origin + t * ray.direction;
+  intersection.distance = distance;
+  intersection.position = ray.origin + distance * ray.direction;
 
   // Now the normal can be computed
   const Vector3 localIntersection = intersection.position - offset;
@@ -251,8 +333,6 @@ bool Paraboloid::Intersect(const Ray ray, Intersection& intersection) const
                                 * Dot(localIntersection, normal);
   intersection.normal = focalPoint - planeProjection;
   intersection.normal.Normalise();
-
-  return true;
 }
 
 // --------------------
@@ -268,8 +348,11 @@ CappedParaboloid::CappedParaboloid(const CappedParaboloid& other)
   , radiusSquared(other.radiusSquared) { }
 
 // TODO: DRY / can code be shared with the paraboloid?
-bool CappedParaboloid::Intersect(const Ray ray,
-                                 Intersection& intersection) const
+bool CappedParaboloid::IntersectDistance(const Ray ray,
+                                         const float tMin,
+                                         const float tMax,
+                                         float& distance,
+                                         int& part) const
 {
   // Transform the ray into the space where the plane is a linear
   // subspace (a plane through the origin)
@@ -295,6 +378,13 @@ bool CappedParaboloid::Intersect(const Ray ray,
   const float sqrtD = std::sqrt(discriminant);
   const float t1 = 0.5f * (-b + sqrtD) / a;
   const float t2 = 0.5f * (-b - sqrtD) / a;
+
+  // Only intersections within the range are of interest, if there are
+  // none, there is no need to compute the points
+  const bool t1InRange = t1 > tMin && t1 < tMax;
+  const bool t2InRange = t2 > tMin && t2 < tMax;
+  if (!t1InRange && !t2InRange) return false;
+
   const Vector3 t1Intersection = localOrigin + t1 * ray.direction;
   const Vector3 t2Intersection = localOrigin + t2 * ray.direction;
   const Vector3 t1PlaneProjection = t1Intersection - normal
@@ -302,27 +392,35 @@ bool CappedParaboloid::Intersect(const Ray ray,
   const Vector3 t2PlaneProjection = t2Intersection - normal
                                   * Dot(t2Intersection, normal);
 
-  float t;
-  Vector3 localIntersection;
-  Vector3 planeProjection;
   // Pick the closest non-negative t, within the valid radius
-  if (t1 > 0.0f && (t1 < t2 || t2 <= 0.0f)
+  if (t1InRange && (t1 < t2 || t2 <= tMin)
       && t1PlaneProjection.MagnitudeSquared() < radiusSquared)
   {
-    t = t1; localIntersection = t1Intersection;
-    planeProjection = t1PlaneProjection;
+    distance = t1;
   }
-  else if (t2 > 0.0f
+  else if (t2InRange
            && t2PlaneProjection.MagnitudeSquared() < radiusSquared)
   {
-    t = t2; localIntersection = t2Intersection;
-    planeProjection = t2PlaneProjection;
+    distance = t2;
   }
   // For negative t, the paraboloid lies behind the ray entirely
   else return false;
 
+  part = 0;
+  return true;
+}
+
+void CappedParaboloid::GetAttributes(const Ray ray, const float distance,
+                                     const int,
+                                     Intersection& intersection) const
+{
+  const Vector3 localOrigin = ray.origin - offset;
+  const Vector3 localIntersection = localOrigin + distance * ray.direction;
+  const Vector3 planeProjection = localIntersection - normal
+                                * Dot(localIntersection, normal);
+
   // Fill in the intersection details
-  intersection.distance = t;
+  intersection.distance = distance;
   intersection.position = localIntersection + offset;
 
   // Now the normal can be computed
@@ -334,6 +432,29 @@ bool CappedParaboloid::Intersect(const Ray ray,
   {
     intersection.normal = -intersection.normal;
   }
+}
+
+bool CappedParaboloid::GetBoundingBox(BoundingBox& box) const
+{
+  // A point at distance r from the axis lies at height
+  // (r^2 + 4f^2) / 4f above the plane, where f is the focal distance.
+  // The paraboloid is therefore contained in a cylinder around the axis
+  // between the top and the height at the maximum radius.
+  const float f = Dot(focalPoint, normal) * 0.5f;
+  const Vector3 top    = offset + normal * f;
+  const Vector3 bottom = offset + normal
+                       * ((radiusSquared + 4.0f * f * f) / (4.0f * f));
+
+  // Then bound the disks at both ends of the cylinder
+  const float radius = std::sqrt(radiusSquared);
+  const Vector3 extent =
+  {
+    radius * std::sqrt(std::fmax(0.0f, 1.0f - normal.x * normal.x)),
+    radius * std::sqrt(std::fmax(0.0f, 1.0f - normal.y * normal.y)),
+    radius * std::sqrt(std::fmax(0.0f, 1.0f - normal.z * normal.z))
+  };
 
+  box.min = Min(top, bottom) - extent;
+  box.max = Max(top, bottom) + extent;
   return true;
 }
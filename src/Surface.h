@@ -19,6 +19,7 @@
 #include "Ray.h"
 #include "Quaternion.h"
 #include "Intersection.h"
+#include "BoundingBox.h"
 #include "Volume.h"
 
 namespace Luculentus
@@ -27,9 +28,30 @@ namespace Luculentus
   {
     public:
 
-      /// Returns whether the surface was intersected, and if so, where.
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const = 0;
+      /// Returns whether the surface was intersected at a distance
+      /// between tMin and tMax (exclusive), and if so, where.
+      bool Intersect(const Ray ray, const float tMin, const float tMax,
+                     Intersection& intersection) const;
+
+      /// Returns whether the surface was intersected at a distance
+      /// between tMin and tMax (exclusive), and if so, at which
+      /// distance. The part identifies what was hit for surfaces that
+      /// consist of multiple parts. Nothing else about the intersection
+      /// is computed, because most candidate intersections are not the
+      /// nearest one anyway.
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const = 0;
+
+      /// Completes an intersection found by IntersectDistance, for the
+      /// same ray.
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const = 0;
+
+      /// Returns whether the surface is bounded, and if so, sets the box
+      /// to a box that contains the entire surface.
+      virtual bool GetBoundingBox(BoundingBox& box) const;
   };
 
   class Plane : public Surface
@@ -48,8 +70,13 @@ namespace Luculentus
       /// Copy constructor
       Plane(const Plane& other);
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const;
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const;
   };
 
   /// Like a one-sided plane, something that cuts space in half.
@@ -63,8 +90,13 @@ namespace Luculentus
       /// Copy constructor
       SpacePartitioning(const SpacePartitioning& other);
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const;
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const;
 
       virtual bool LiesInside(const Vector3 x) const;
   };
@@ -86,8 +118,11 @@ namespace Luculentus
       /// Copy constructor
       Circle(const Circle& other);
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const;
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual bool GetBoundingBox(BoundingBox& box) const;
   };
 
   class Sphere : public Surface, public Volume
@@ -105,8 +140,15 @@ namespace Luculentus
       /// Copy constructor
       Sphere(const Sphere& other);
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const;
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const;
+
+      virtual bool GetBoundingBox(BoundingBox& box) const;
 
       virtual bool LiesInside(const Vector3 x) const;
 
@@ -142,8 +184,13 @@ namespace Luculentus
       /// Copy constructor
       Paraboloid(const Paraboloid& other);
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const;
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const;
   };
 
   class CappedParaboloid : public Paraboloid
@@ -164,7 +211,14 @@ namespace Luculentus
       /// Copy constructor
       CappedParaboloid(const CappedParaboloid& other);
 
-      virtual bool Intersect(const Ray ray,
-                             Intersection& intersection) const;
+      virtual bool IntersectDistance(const Ray ray,
+                                     const float tMin, const float tMax,
+                                     float& distance, int& part) const;
+
+      virtual void GetAttributes(const Ray ray, const float distance,
+                                 const int part,
+                                 Intersection& intersection) const;
+
+      virtual bool GetBoundingBox(BoundingBox& box) const;
   };
 }
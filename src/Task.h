@@ -36,7 +36,15 @@ namespace Luculentus
       Gather,
       /// Convert and tonemap the CIE XYZ values
       /// to sRGB and display the image.
-      Tonemap
+      Tonemap,
+      /// Find the visible points of a band of pixels for photon mapping.
+      Locate,
+      /// Build the spatial hash of the visible points.
+      Index,
+      /// Emit photons and add them to the visible points.
+      Emit,
+      /// Add the photons of the iteration to the photon mapped image.
+      Update
     }
     /// The type of thing that should be done.
     type;
@@ -44,8 +52,15 @@ namespace Luculentus
     /// The index of the unit to use to execute the task (for trace and plot tasks).
     int unit;
 
+    /// The band of rows of pixels to locate (for locate tasks).
+    int band;
+
     /// The units that should be processed, e.g. for a Plot task, this
     /// contains the indices of the TraceUnits that must be plotted.
     std::vector<int> otherUnits;
+
+    /// Creates a task of the specified type, that uses no unit.
+    Task(const TaskType taskType = Sleep)
+      : type(taskType), unit(-1), band(-1) { }
   };
 }
@@ -26,7 +26,8 @@ using std::chrono::duration_cast;
 const steady_clock::duration TaskScheduler::tonemappingInterval = std::chrono::seconds(30);
 
 TaskScheduler::TaskScheduler(const int numberOfThreads, const int width,
-                             const int height, const Scene& scene)
+                             const int height, const CompiledScene& scene,
+                             const RenderSettings& settings)
 {
   // More trace units than threads seems sensible,
   // but less plot units is acceptable,
@@ -34,17 +35,26 @@ TaskScheduler::TaskScheduler(const int numberOfThreads, const int width,
   numberOfTraceUnits = std::max(1, numberOfThreads * 3);
   numberOfPlotUnits  = std::max(1, numberOfThreads / 2);
 
+  // Fused trace units need not wait to be plotted, but every unit that
+  // traces needs a plot unit, and the others can fill up while some are
+  // being gathered
+  fusedPlotting = settings.fusedPlotting
+    && settings.integrator != RenderSettings::ProgressivePhotonMapping;
+  if (fusedPlotting)
+  {
+    numberOfTraceUnits = std::max(1, numberOfThreads);
+    numberOfPlotUnits  = std::max(1, numberOfThreads * 2);
+  }
+
   // Allocate some space for the work unit arrays
   traceUnits.reserve(numberOfTraceUnits);
   plotUnits.reserve(numberOfPlotUnits);
 
-  // Build all the trace units, with a different random seed for all units
-  unsigned long randomSeed = std::random_device()();
+  // Build all the trace units, every unit has its own random streams
   for (size_t i = 0; i < numberOfTraceUnits; i++)
   {
-    traceUnits.emplace_back(scene, randomSeed, width, height);
-    // Pick a different random seed for the next trace unit
-    randomSeed = traceUnits[i].monteCarloUnit.randomEngine();
+    traceUnits.emplace_back(scene, static_cast<std::uint32_t>(i), width,
+                            height, settings);
   }
 
   // Then build the plot units
@@ -54,7 +64,9 @@ TaskScheduler::TaskScheduler(const int numberOfThreads, const int width,
   }
 
   // There must be one gather unit
-  gatherUnit = std::unique_ptr<GatherUnit>(new GatherUnit(width, height));
+  gatherUnit = std::unique_ptr<GatherUnit>(new GatherUnit(width, height,
+    TraceUnit::tilesPerRow, traceUnits.front().tilesPerColumn,
+    settings.adaptiveSampling));
 
   // And finally the tonemap unit
   tonemapUnit = std::unique_ptr<TonemapUnit>(new TonemapUnit(width, height));
@@ -71,6 +83,22 @@ TaskScheduler::TaskScheduler(const int numberOfThreads, const int width,
   // Tonemap as soon as possible
   lastTonemapTime = steady_clock::now();
   completedTraces = 0;
+  tracedPaths = 0;
+  storedPhotons = 0;
+
+  adaptiveSampling = settings.adaptiveSampling;
+
+  // Photon mapping starts by locating the visible points, and emits
+  // photons with one trace unit per thread
+  if (settings.integrator == RenderSettings::ProgressivePhotonMapping)
+  {
+    photonMapUnit = std::unique_ptr<PhotonMapUnit>(new PhotonMapUnit(
+      width, height, scene, settings));
+  }
+  photonMapPhase = Locating;
+  issuedPhotonMapTasks = 0;
+  pendingPhotonMapTasks = 0;
+  emitTasksPerIteration = std::max(1, numberOfThreads);
 }
 
 Task TaskScheduler::GetNewTask(const Task completedTask)
@@ -100,18 +128,24 @@ Task TaskScheduler::GetNewTask(const Task completedTask)
     {
       // Otherwise, plots must first be gathered, tonemapping will
       // happen once that is done
+      if (fusedPlotting && gatherUnitAvailable) FlushPlotUnits();
       if (gatherUnitAvailable && !donePlotUnits.empty())
         return CreateGatherTask();
     }
   }
 
+  // Photon mapping does not plot, it goes through its own steps
+  if (photonMapUnit) return CreatePhotonMapTask();
+
   // If a substantial number of trace units is done, plot them first
   // so they can be recycled soon
   if (doneTraceUnits.size() > numberOfTraceUnits / 2
       && !availablePlotUnits.empty()) return CreatePlotTask();
 
   // Then, if there are enough trace units available, go trace some rays!
-  if (!availableTraceUnits.empty())
+  // Fused trace units need a plot unit as well.
+  if (!availableTraceUnits.empty()
+      && (!fusedPlotting || !availablePlotUnits.empty()))
   {
     return CreateTraceTask();
   }
@@ -149,9 +183,34 @@ Task TaskScheduler::CreateTraceTask()
   task.unit = availableTraceUnits.front();
   availableTraceUnits.pop();
 
+  // The gather unit may not be touched during gathering, so the trace
+  // unit gets the densities of the last gather task
+  if (adaptiveSampling)
+    traceUnits[task.unit].SetTileDensities(tileDensities);
+
+  // A fused trace unit plots into the first available plot unit
+  if (fusedPlotting)
+  {
+    task.otherUnits.push_back(availablePlotUnits.front());
+    availablePlotUnits.pop();
+  }
+
   return task;
 }
 
+void TaskScheduler::FlushPlotUnits()
+{
+  // Plot units that are not in use are handed in if they have anything
+  for (size_t i = availablePlotUnits.size(); i > 0; i--)
+  {
+    const int unit = availablePlotUnits.front();
+    availablePlotUnits.pop();
+
+    if (plotUnits[unit].plottedPaths > 0) donePlotUnits.push(unit);
+    else availablePlotUnits.push(unit);
+  }
+}
+
 Task TaskScheduler::CreatePlotTask()
 {
   // Pick the first available plot unit, and use it for the task
@@ -202,6 +261,75 @@ Task TaskScheduler::CreateTonemapTask()
   return task;
 }
 
+Task TaskScheduler::CreatePhotonMapTask()
+{
+  switch (photonMapPhase)
+  {
+    case Locating:
+      if (issuedPhotonMapTasks < photonMapUnit->numberOfBands
+          && !availableTraceUnits.empty()) return CreateLocateTask();
+      break;
+
+    case Indexing:
+      if (issuedPhotonMapTasks == 0)
+      {
+        Task task; task.type = Task::Index;
+        issuedPhotonMapTasks++;
+        pendingPhotonMapTasks++;
+        return task;
+      }
+      break;
+
+    case Emitting:
+      if (issuedPhotonMapTasks < emitTasksPerIteration
+          && !availableTraceUnits.empty()) return CreateEmitTask();
+      break;
+
+    case Updating:
+      // The update writes the image to the gather unit, which the
+      // tonemap unit might be reading
+      if (issuedPhotonMapTasks == 0 && gatherUnitAvailable)
+      {
+        Task task; task.type = Task::Update;
+        gatherUnitAvailable = false;
+        issuedPhotonMapTasks++;
+        pendingPhotonMapTasks++;
+        return task;
+      }
+      break;
+  }
+
+  // Otherwise, the other tasks of the step must complete first
+  return CreateSleepTask();
+}
+
+Task TaskScheduler::CreateLocateTask()
+{
+  // Pick the first available trace unit, and have it locate the next band
+  Task task; task.type = Task::Locate;
+  task.unit = availableTraceUnits.front();
+  task.band = issuedPhotonMapTasks;
+  availableTraceUnits.pop();
+
+  issuedPhotonMapTasks++;
+  pendingPhotonMapTasks++;
+
+  return task;
+}
+
+Task TaskScheduler::CreateEmitTask()
+{
+  // Pick the first available trace unit, and use it for the task
+  Task task; task.type = Task::Emit;
+  task.unit = availableTraceUnits.front();
+  availableTraceUnits.pop();
+
+  issuedPhotonMapTasks++;
+  pendingPhotonMapTasks++;
+
+  return task;
+}
+
 void TaskScheduler::CompleteTask(const Task completedTask)
 {
   // Delegate the task to the correct method
@@ -211,6 +339,10 @@ void TaskScheduler::CompleteTask(const Task completedTask)
     case Task::Plot:    CompletePlotTask(completedTask);    break;
     case Task::Gather:  CompleteGatherTask(completedTask);  break;
     case Task::Tonemap: CompleteTonemapTask();              break;
+    case Task::Locate:
+    case Task::Index:
+    case Task::Emit:
+    case Task::Update:  CompletePhotonMapTask(completedTask); break;
     case Task::Sleep:                                       break;
   }
 
@@ -222,11 +354,29 @@ void TaskScheduler::CompleteTraceTask(const Task completedTask)
 {
   std::cout << "done tracing with unit " << completedTask.unit << std::endl;
 
+  completedTraces++;
+  tracedPaths += TraceUnit::numberOfPaths;
+  storedPhotons += traceUnits[completedTask.unit].numberOfPhotons;
+
+  // A fused trace unit plotted its photons already, so it is available
+  // again right away. Its plot unit is gathered once it is full enough.
+  if (fusedPlotting)
+  {
+    availableTraceUnits.push(completedTask.unit);
+
+    const int plotUnit = completedTask.otherUnits.front();
+    if (plotUnits[plotUnit].plottedPaths
+        >= fusedBatchesPerPlot * TraceUnit::numberOfPaths)
+      donePlotUnits.push(plotUnit);
+    else
+      availablePlotUnits.push(plotUnit);
+
+    return;
+  }
+
   // The trace unit used for the task, now need plotting before it is
   // available again
   doneTraceUnits.push(completedTask.unit);
-
-  completedTraces++;
 }
 
 void TaskScheduler::CompletePlotTask(Task completedTask)
@@ -267,10 +417,51 @@ void TaskScheduler::CompleteGatherTask(Task completedTask)
   // And the gather unit can now be used again as well
   gatherUnitAvailable = true;
 
+  // Its noise estimates decide where the next camera rays go
+  tileDensities = gatherUnit->tileDensities;
+
   // The image must have changed because of gathering
   imageChanged = true;
 }
 
+void TaskScheduler::CompletePhotonMapTask(const Task completedTask)
+{
+  // Trace units can locate or emit again right away, nothing needs to
+  // be plotted
+  if (completedTask.type == Task::Locate
+      || completedTask.type == Task::Emit)
+    availableTraceUnits.push(completedTask.unit);
+
+  if (completedTask.type == Task::Emit) completedTraces++;
+
+  pendingPhotonMapTasks--;
+
+  // Move on to the next step once all tasks of this step are done
+  const int tasksInPhase
+    = photonMapPhase == Locating ? photonMapUnit->numberOfBands
+    : photonMapPhase == Emitting ? emitTasksPerIteration
+    : 1;
+  if (pendingPhotonMapTasks > 0 || issuedPhotonMapTasks < tasksInPhase)
+    return;
+
+  issuedPhotonMapTasks = 0;
+  switch (photonMapPhase)
+  {
+    case Locating: photonMapPhase = Indexing; break;
+    case Indexing: photonMapPhase = Emitting; break;
+    case Emitting: photonMapPhase = Updating; break;
+    case Updating:
+      std::cout << "done with photon mapping iteration "
+                << photonMapUnit->iterations << std::endl;
+
+      // The update wrote a new image to the gather unit
+      gatherUnitAvailable = true;
+      imageChanged = true;
+      photonMapPhase = Locating;
+      break;
+  }
+}
+
 #include <algorithm>
 
 void TaskScheduler::CompleteTonemapTask()
@@ -309,4 +500,13 @@ void TaskScheduler::CompleteTonemapTask()
 
   std::cout << "performance: " << mean << " +- " << std::sqrt(variance)
             << " batches/sec" << std::endl;
+
+  // Paths that carry no light are not stored or plotted
+  if (tracedPaths > 0)
+  {
+    std::cout << "photons: " << storedPhotons << " of " << tracedPaths
+              << " paths carried light" << std::endl;
+  }
+  tracedPaths = 0;
+  storedPhotons = 0;
 }
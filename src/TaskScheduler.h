@@ -21,6 +21,7 @@
 #include <mutex>
 #include <queue>
 #include "GatherUnit.h"
+#include "PhotonMapUnit.h"
 #include "PlotUnit.h"
 #include "Task.h"
 #include "TonemapUnit.h"
@@ -28,7 +29,7 @@
 
 namespace Luculentus
 {
-  class Scene;
+  class CompiledScene;
   class UserInterface;
 
   /// Handles splitting the workload across threads
@@ -69,9 +70,56 @@ namespace Luculentus
       /// Used to measure performance.
       unsigned int completedTraces;
 
+      /// The number of paths that were traced, and the number of photons
+      /// that they left, since the last tonemap. Paths that carry no
+      /// light leave no photon.
+      std::uint64_t tracedPaths, storedPhotons;
+
       /// Previous measurements of batches/second, used to determine variance.
       std::deque<float> performance;
 
+      /// Whether camera rays are concentrated on noisy tiles.
+      bool adaptiveSampling;
+
+      /// Whether trace units plot their photons themselves, into a plot
+      /// unit that they take along with the trace task.
+      bool fusedPlotting;
+
+      /// The number of batches that a plot unit collects from fused
+      /// trace units before it is gathered.
+      static const int fusedBatchesPerPlot = 8;
+
+      /// The latest tile densities of the GatherUnit, which are handed to
+      /// TraceUnits when they start tracing.
+      std::vector<float> tileDensities;
+
+      /// The steps of an iteration of progressive photon mapping. Every
+      /// step must be complete before the next one starts.
+      enum PhotonMapPhase
+      {
+        /// Trace units find the visible points, one band at a time.
+        Locating,
+        /// The visible points are put in a spatial hash.
+        Indexing,
+        /// Trace units emit photons.
+        Emitting,
+        /// The photons are added to the image in the gather unit.
+        Updating
+      }
+      /// The current step of photon mapping.
+      photonMapPhase;
+
+      /// The number of tasks that were handed out in the current step of
+      /// photon mapping.
+      int issuedPhotonMapTasks;
+
+      /// The number of tasks of the current step of photon mapping that
+      /// are not complete yet.
+      int pendingPhotonMapTasks;
+
+      /// The number of emit tasks per iteration of photon mapping.
+      int emitTasksPerIteration;
+
       /// A mutex that ensures only one thread can
       /// access the task scheduler at a given instant.
       std::mutex mutex;
@@ -101,10 +149,15 @@ namespace Luculentus
       /// The single TonemapUnit.
       std::unique_ptr<TonemapUnit> tonemapUnit;
 
+      /// The photon map, only when rendering with progressive photon
+      /// mapping.
+      std::unique_ptr<PhotonMapUnit> photonMapUnit;
+
       /// Creates a new task scheduler, that will render the specified
       /// scene to a canvas of specified size.
       TaskScheduler(const int numberOfThreads, const int width,
-                    const int height, const Scene& scene);
+                    const int height, const CompiledScene& scene,
+                    const RenderSettings& settings);
 
       /// Notifies the task scheduler that a task is complete.
       /// The task scheduler will find some more work to do,
@@ -120,6 +173,10 @@ namespace Luculentus
       /// Creates a new 'Trace' task.
       Task CreateTraceTask();
 
+      /// Hands in the plot units that fused trace units plotted into,
+      /// so they can be gathered before they are full.
+      void FlushPlotUnits();
+
       /// Creates a new 'Plot' task that plots some TraceUnits which are
       /// done.
       Task CreatePlotTask();
@@ -131,6 +188,16 @@ namespace Luculentus
       /// Creates a new 'Tonemap' task.
       Task CreateTonemapTask();
       
+      /// Creates the next task of the current step of photon mapping, or
+      /// a 'Sleep' task if the step has to complete first.
+      Task CreatePhotonMapTask();
+
+      /// Creates a new 'Locate' task for the next band of pixels.
+      Task CreateLocateTask();
+
+      /// Creates a new 'Emit' task.
+      Task CreateEmitTask();
+
       /// Makes resources used by the task available again.
       void CompleteTask(const Task completeTask);
 
@@ -145,5 +212,9 @@ namespace Luculentus
 
       /// Makes resourced used by a 'Tonemap' task available again.
       void CompleteTonemapTask();
+
+      /// Makes resources used by a photon mapping task available again,
+      /// and moves on to the next step once the current one is complete.
+      void CompletePhotonMapTask(const Task completedTask);
   };
 }
@@ -16,58 +16,347 @@
 
 #include "TraceUnit.h"
 
-#include "Scene.h"
+#include <algorithm>
+#include <cstring>
+#include "CompiledScene.h"
+#include "Constants.h"
+#include "PhotonMapUnit.h"
+#include "PlotUnit.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 using namespace Luculentus;
 
-TraceUnit::TraceUnit(const Scene& scn,
-                     const unsigned long randomSeed, const int width,
-                     const int height)
-  : monteCarloUnit(randomSeed)
+// Sizes that are passed by reference need a definition
+const int TraceUnit::wavefrontSize;
+const int TraceUnit::packetSize;
+const int TraceUnit::maxSplits;
+
+// Creates the sampler of the specified type.
+std::shared_ptr<const Sampler> MakeSampler(
+  const RenderSettings::SamplerType type)
+{
+  switch (type)
+  {
+    case RenderSettings::Sobol:  return std::make_shared<SobolSampler>();
+    case RenderSettings::Halton: return std::make_shared<HaltonSampler>();
+    default:                     return std::make_shared<RandomSampler>();
+  }
+}
+
+// Returns the largest ratio between the chromatic zooms of two
+// wavelengths, which is reached at the ends of the spectrum.
+float GetLargestZoomRatio(const CompiledScene& scene)
+{
+  // The amount of chromatic aberration is assumed not to change over
+  // time, as in PlotUnit::Plot.
+  const Camera camera = scene.GetCameraAtTime(0.0f);
+  const float blueZoom = camera.GetChromaticZoom(380.0f);
+  const float redZoom = camera.GetChromaticZoom(780.0f);
+  return std::max(blueZoom, redZoom) / std::min(blueZoom, redZoom);
+}
+
+TraceUnit::TraceUnit(const CompiledScene& scn,
+                     const std::uint32_t unitIndex, const int width,
+                     const int height,
+                     const RenderSettings& renderSettings)
+  : monteCarloUnit(unitIndex, MakeSampler(renderSettings.sampler),
+                   numberOfPaths)
   , scene(scn)
   , aspectRatio(static_cast<float>(width) / static_cast<float>(height))
+  , screenScale(GetLargestZoomRatio(scn))
+  , settings(renderSettings)
+  , wavelengthDistribution(scn, renderSettings.wavelengths)
+  , tilesPerColumn(std::max(1, static_cast<int>(tilesPerRow / aspectRatio
+                                                 + 0.5f)))
+  , numberOfPhotons(0)
+  , packetWeights(numberOfPaths / packetSize, 1.0f)
+  , unit(unitIndex)
+  , batch(0)
 {
+  // Photons are stored only for as long as a plot unit has to wait for
+  // them
+  if (settings.integrator == RenderSettings::ProgressivePhotonMapping)
+    return;
 
+  if (!settings.fusedPlotting)
+    packedPhotons.resize(numberOfMappedPhotons);
+  if (settings.integrator == RenderSettings::Wavefront)
+    wavefrontPhotons.resize(wavefrontSize);
+}
+
+void TraceUnit::SetTileDensities(const std::vector<float>& densities)
+{
+  tileDensities = densities;
+  tileCumulative.resize(densities.size() + 1);
+
+  tileCumulative[0] = 0.0f;
+  for (size_t i = 0; i < densities.size(); i++)
+    tileCumulative[i + 1] = tileCumulative[i] + densities[i];
 }
 
 void TraceUnit::Render()
 {
-  for (auto& mappedPhoton : mappedPhotons)
+  RenderBatch(nullptr);
+}
+
+void TraceUnit::Render(PlotUnit& plotUnit)
+{
+  RenderBatch(&plotUnit);
+  plotUnit.plottedPaths += numberOfPaths;
+}
+
+void TraceUnit::RenderBatch(PlotUnit* plotUnit)
+{
+  lightPhotons.clear();
+  numberOfPhotons = 0;
+
+  if (settings.integrator == RenderSettings::Wavefront)
+  {
+    RenderWavefront(plotUnit);
+    batch++;
+    return;
+  }
+
+  // The lens zooms in on every wavelength differently. The amount of
+  // chromatic aberration is assumed not to change over time, as in
+  // PlotUnit::Plot.
+  const Camera camera = scene.GetCameraAtTime(0.0f);
+
+  for (int begin = 0; begin < numberOfPaths; begin += packetSize)
+  {
+    // Photons only need to last a packet, then they are plotted, or
+    // packed after the photons of the previous packets
+    MappedPhoton photons[packetSize];
+    const int size = std::min(packetSize, numberOfPaths - begin);
+
+    // The first bounce is traced as a packet
+    Ray rays[packetSize];
+    Intersection intersections[packetSize];
+    int primitives[packetSize];
+    std::uint32_t positions[packetSize];
+    float times[packetSize];
+    GenerateCameraPacket(photons, begin, size, rays, positions, times);
+    scene.IntersectPacket(rays, size, intersections, primitives);
+
+    // And then every path continues on its own
+    for (int i = 0; i < size; i++)
+    {
+      monteCarloUnit.SetStream(batch, begin + i, positions[i]);
+      photons[i].probability
+        = settings.integrator == RenderSettings::Bidirectional
+        ? RenderBidirectional(rays[i], primitives[i], intersections[i],
+                              times[i])
+        : RenderRay(rays[i], primitives[i], intersections[i]);
+    }
+
+    // Only the photons that carry light are kept
+    const int kept = CompactPhotons(photons, size,
+                                    packetWeights[begin / packetSize],
+                                    photons);
+
+    if (plotUnit)
+    {
+      plotUnit->PlotPhotons(photons, kept, camera, wavelengthDistribution);
+      plotUnit->PlotPhotons(lightPhotons.data(),
+                            static_cast<int>(lightPhotons.size()), camera,
+                            wavelengthDistribution);
+      lightPhotons.clear();
+    }
+    else PackPhotons(photons, kept);
+
+    numberOfPhotons += kept;
+  }
+
+  batch++;
+}
+
+void TraceUnit::GenerateCameraPacket(MappedPhoton* photons,
+                                     const int firstPath, const int size,
+                                     Ray* rays, std::uint32_t* positions,
+                                     float* times)
+{
+  // Packets visit the tiles in order, so consecutive photons land close
+  // together on the screen. A batch does not cover every tile equally
+  // often, so it starts at a random tile, which makes every tile equally
+  // likely on average.
+  const int numberOfTiles = tilesPerRow * tilesPerColumn;
+  const int packet = firstPath / packetSize;
+  const std::uint32_t start = Sampler::Hash(Sampler::Hash(unit) + batch);
+  int tile;
+
+  if (static_cast<int>(tileDensities.size()) == numberOfTiles)
+  {
+    // With densities, the packets are spread evenly over the cumulative
+    // distribution instead, so dense tiles get several packets in a
+    // row, and photons in them count less
+    const int numberOfPackets = numberOfPaths / packetSize;
+    float u = start * (1.0f / 4294967296.0f)
+            + static_cast<float>(packet) / numberOfPackets;
+    if (u >= 1.0f) u -= 1.0f;
+
+    tile = static_cast<int>(std::upper_bound(tileCumulative.begin() + 1,
+                                             tileCumulative.end() - 1, u)
+                            - tileCumulative.begin()) - 1;
+    packetWeights[packet] = 1.0f / (tileDensities[tile] * numberOfTiles);
+  }
+  else
+  {
+    tile = static_cast<int>((start + static_cast<std::uint32_t>(packet))
+                            % static_cast<std::uint32_t>(numberOfTiles));
+    packetWeights[packet] = 1.0f;
+  }
+
+  // The tiles cover the enlarged screen, so the photons are spread over
+  // a larger area, and every one of them counts for more. Wavelengths
+  // that land outside the screen are not plotted.
+  packetWeights[packet] *= screenScale * screenScale;
+
+  const int tileX = tile % tilesPerRow;
+  const int tileY = tile / tilesPerRow;
+
+  const float strataWidth = 2.0f * screenScale / (tilesPerRow * strataPerSide);
+  const float strataHeight = 2.0f * screenScale / (tilesPerColumn
+                                                   * strataPerSide
+                                                   * aspectRatio);
+
+  for (int i = 0; i < size; i++)
+  {
+    // Every path takes its dimensions in the same order: the position
+    // within its stratum, the hero wavelength, the time, and then the lens
+    // position in the camera
+    float s[4];
+    monteCarloUnit.SetStream(batch, firstPath + i);
+    monteCarloUnit.FillUnit(s, 4);
+
+    const int stratumX = tileX * strataPerSide + i % strataPerSide;
+    const int stratumY = tileY * strataPerSide + i / strataPerSide;
+    const float x = (stratumX + s[0]) * strataWidth - screenScale;
+    const float y = (stratumY + s[1]) * strataHeight
+                  - screenScale / aspectRatio;
+    const float wavelength = wavelengthDistribution.Sample(s[2]);
+    rays[i] = GenerateCameraRay(photons[i], x, y, wavelength, s[3]);
+    positions[i] = monteCarloUnit.GetPosition();
+    if (times) times[i] = s[3];
+  }
+}
+
+int TraceUnit::CompactPhotons(const MappedPhoton* photons, const int count,
+                              const float weight, MappedPhoton* destination)
+{
+  int kept = 0;
+  for (int i = 0; i < count; i++)
+  {
+    // Paths that escaped, were ended by roulette, or found no light
+    // would only add zeros to the screen
+    if (GetAverage(photons[i].probability) == 0.0f) continue;
+
+    destination[kept] = photons[i];
+    destination[kept].probability = photons[i].probability * weight;
+    kept++;
+  }
+
+  return kept;
+}
+
+// Returns the IEEE half-precision float nearest to the float, which
+// must not be negative. Values that are too large become the largest
+// half, so a bright photon does not become infinite.
+inline std::uint16_t ToHalf(const float value)
+{
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  // The exponent is biased by 127 for floats and 15 for halves
+  const int exponent = static_cast<int>(bits >> 23) - 127 + 15;
+  std::uint32_t mantissa = bits & 0x7fffffu;
+
+  if (exponent >= 31) return 0x7bff;
+  if (exponent <= 0)
   {
-    // Pick a wavelength for this photon
-    const float wavelength = monteCarloUnit.GetWavelength();
+    // Subnormal halves lose the implicit one into the mantissa
+    if (exponent < -10) return 0;
+    mantissa |= 0x800000u;
+    const int shift = 14 - exponent;
+    const std::uint32_t half = mantissa >> shift;
+    const std::uint32_t rest = mantissa & ((1u << shift) - 1u);
+    const std::uint32_t middle = 1u << (shift - 1);
+    return static_cast<std::uint16_t>(
+      half + (rest > middle || (rest == middle && (half & 1u))));
+  }
+
+  // Round to nearest even, which may carry into the exponent
+  std::uint32_t half = (static_cast<std::uint32_t>(exponent) << 10)
+                     | (mantissa >> 13);
+  const std::uint32_t rest = mantissa & 0x1fffu;
+  if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;
+  return static_cast<std::uint16_t>(std::min(half, 0x7bffu));
+}
+
+// Returns the fixed-point value of a real in the range 0 .. 1.
+inline std::uint16_t ToFixed(const float unit)
+{
+  const float scaled = std::max(0.0f, std::min(1.0f, unit)) * 65535.0f;
+  return static_cast<std::uint16_t>(scaled + 0.5f);
+}
 
-    // Pick a screen coordinate for the photon
-    const float x = monteCarloUnit.GetBiUnit();
-    const float y = monteCarloUnit.GetBiUnit() / aspectRatio;
+void TraceUnit::PackPhotons(const MappedPhoton* photons, const int count)
+{
+  PackedPhoton* const packed = packedPhotons.data() + numberOfPhotons;
 
-    // Store the pixel coordinates already
-    mappedPhoton.wavelength = wavelength;
-    mappedPhoton.x = x;
-    mappedPhoton.y = y;
-    
-    // And then trace the scene at this wavelength
-    mappedPhoton.probability = RenderCameraRay(x, y, wavelength);
+  for (int i = 0; i < count; i++)
+  {
+    const MappedPhoton& photon = photons[i];
+    packed[i].x = ToFixed(photon.x / screenScale * 0.5f + 0.5f);
+    packed[i].y = ToFixed(photon.y * aspectRatio / screenScale * 0.5f
+                          + 0.5f);
+    packed[i].wavelength = ToFixed((photon.wavelength - 380.0f) / 400.0f);
+    packed[i].padding = 0;
+
+    #if defined(__F16C__)
+    static_assert(Spectrum::size == 4, "A spectrum must fit in a vector.");
+    const __m128 probability = _mm_min_ps(
+      _mm_loadu_ps(photon.probability.values), _mm_set1_ps(65504.0f));
+    const __m128i halves = _mm_cvtps_ph(probability,
+                                        _MM_FROUND_TO_NEAREST_INT);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(packed[i].probability),
+                     halves);
+    #else
+    for (int j = 0; j < Spectrum::size; j++)
+      packed[i].probability[j] = ToHalf(photon.probability[j]);
+    #endif
   }
 }
 
-float TraceUnit::RenderCameraRay(const float x, const float y,
-                                 const float wavelength)
+Ray TraceUnit::GenerateCameraRay(MappedPhoton& mappedPhoton, const float x,
+                                 const float y, const float wavelength,
+                                 const float t)
 {
-  // Get a random time to sample at
-  const float t = monteCarloUnit.GetUnit();
+  // Store the pixel coordinates already
+  mappedPhoton.wavelength = wavelength;
+  mappedPhoton.x = x;
+  mappedPhoton.y = y;
 
   // Get the camera at that time
   const Camera camera = scene.GetCameraAtTime(t);
 
   // Create a camera ray for the specified pixel and wavelength
-  Ray ray = camera.GetRay(x, y, wavelength, monteCarloUnit);
-  
-  // And render this new camera ray
-  return RenderRay(ray);
+  return camera.GetRay(x, y, wavelength, monteCarloUnit);
+}
+
+// Returns the position in the random stream at which a copy of a path
+// continues, when the path was split at the specified position. Copies
+// continue far apart, so their numbers do not overlap.
+inline std::uint32_t GetSplitPosition(const std::uint32_t position,
+                                      const int copy)
+{
+  return Sampler::Hash(Sampler::Hash(position) + copy);
 }
 
-float TraceUnit::RenderRay(Ray ray)
+Spectrum TraceUnit::RenderRay(Ray ray, int primitive,
+                              Intersection intersection)
 {
   // The path starts with the ray,
   // and there is a chance it continues
@@ -76,47 +365,990 @@ float TraceUnit::RenderRay(Ray ray)
   // Apart from the chance, which might decrease even for specular
   // bounces, light intensity is affected only by interaction
   // probabilities
-  float intensity = 1.0f;
+  Spectrum intensity = MakeSpectrum(1.0f);
 
-  do
-  {
-    // Intersect the ray with the scene
-    Intersection intersection;
-    const Object* object = scene.Intersect(ray, intersection);
+  // Whether only the hero wavelength is still carried by the path
+  bool dispersed = false;
+
+  // The number of bounces so far
+  int depth = 0;
+
+  // The wavelengths that the path carries
+  const Spectrum wavelengths
+    = wavelengthDistribution.GetWavelengths(ray.wavelength);
 
+  // The light found along the path and the paths split off from it
+  Spectrum light = MakeSpectrum(0.0f);
+
+  // The density with which the last bounce picked the direction of the
+  // ray, if the light it hits could also have been sampled directly
+  float bouncePdf = 0.0f;
+
+  for (;;)
+  {
     // If nothing was intersected, the path ends,
     // and the only thing left is the utter darkness of The Void
-    if (!object) return 0.0f;
+    int continuations = 0;
+    int material = -1;
+
+    if (primitive != -1)
+    {
+      // If a light was hit, the path ends, and the intensity of the
+      // light determines the intensity of the path.
+      material = scene.primitives[primitive].material;
+      if (scene.IsEmissive(material))
+      {
+        light += intensity
+          * GetBounceWeight(bouncePdf, primitive, ray, intersection)
+          * scene.GetIntensities(material, wavelengths);
+      }
+      else
+      {
+        // Diffuse surfaces also look at the lights directly
+        if (settings.directLighting && scene.IsDiffuse(material))
+        {
+          light += intensity
+            * SampleDirectLight(material, ray, wavelengths, intersection);
+        }
 
-    // If a light was hit, the path ends,
-    // and the intensity of the light determines the intensity of the path.
-    if (!object->material)
+        // Otherwise, the ray must have hit a non-emissive surface,
+        // and so the journey continues, possibly more than once
+        continuations = GetContinuations(intensity, continueChance, depth);
+        const std::uint32_t position = monteCarloUnit.GetPosition();
+        for (int i = 1; i < continuations; i++)
+        {
+          const SplitPath split = { ray, intersection, material, intensity,
+                                    dispersed, continueChance, depth,
+                                    GetSplitPosition(position, i) };
+          splitPaths.push_back(split);
+        }
+      }
+    }
+
+    // Once the path has ended, the paths that were split off from it
+    // still have to scatter, until none are left
+    if (continuations == 0)
     {
-      return intensity * object->emissiveMaterial->GetIntensity(ray.wavelength);
+      if (splitPaths.empty()) return light;
+
+      const SplitPath& split = splitPaths.back();
+      ray = split.ray;
+      intersection = split.intersection;
+      material = split.material;
+      intensity = split.intensity;
+      dispersed = split.dispersed;
+      continueChance = split.continueChance;
+      depth = split.depth;
+      monteCarloUnit.SetPosition(split.randomPosition);
+      splitPaths.pop_back();
     }
 
-    // Otherwise, the ray must have hit a non-emissive surface,
-    // and so the journey continues ...
-    ray = object->material->GetNewRay(ray, intersection, monteCarloUnit);
-    intensity *= ray.probability;
+    ray = Scatter(material, ray, wavelengths, intersection, intensity,
+                  dispersed, continueChance);
+    bouncePdf = GetBouncePdf(material, ray, intersection);
+    depth++;
+
+    // Intersect the new ray with the scene
+    primitive = scene.Intersect(ray, intersection);
+  }
+}
+
+// Returns the weight of a sample with density a, that could also have
+// been taken with density b.
+inline float PowerHeuristic(const float a, const float b)
+{
+  return a * a / (a * a + b * b);
+}
+
+Spectrum TraceUnit::SampleDirectLight(const int material, const Ray ray,
+                                      const Spectrum wavelengths,
+                                      const Intersection intersection)
+{
+  CompiledScene::LightSample sample;
+  if (!scene.SampleLight(intersection.position, monteCarloUnit, sample))
+    return MakeSpectrum(0.0f);
+
+  // Light reaches the side of the surface that the ray came from
+  const Vector3 normal = Dot(ray.direction, intersection.normal) < 0.0f
+    ? intersection.normal : -intersection.normal;
+  const float cosTheta = Dot(sample.direction, normal);
+  if (cosTheta <= 0.0f) return MakeSpectrum(0.0f);
+
+  // Trace a shadow ray, displaced like a bounce, that stops just before
+  // the light
+  Ray shadowRay;
+  shadowRay.origin = GetRayOrigin(intersection.position, intersection.normal,
+                                  sample.direction);
+  shadowRay.direction = sample.direction;
+  shadowRay.wavelength = ray.wavelength;
+  shadowRay.probability = 1.0f;
+  if (scene.IsOccluded(shadowRay, sample.distance * 0.999f))
+    return MakeSpectrum(0.0f);
+
+  // The diffuse bounce would have picked the direction with density
+  // cos(theta) / pi, and the reflected light is that density times the
+  // reflectance
+  const float bouncePdf = cosTheta / static_cast<float>(pi);
+  return bouncePdf / sample.pdf * PowerHeuristic(sample.pdf, bouncePdf)
+       * scene.GetReflectances(material, wavelengths)
+       * scene.GetIntensities(sample.material, wavelengths);
+}
+
+float TraceUnit::GetBounceWeight(const float bouncePdf, const int primitive,
+                                 const Ray ray,
+                                 const Intersection intersection) const
+{
+  if (bouncePdf == 0.0f) return 1.0f;
+
+  const float lightPdf = scene.GetLightPdf(primitive, ray, intersection);
+  return PowerHeuristic(bouncePdf, lightPdf);
+}
+
+float TraceUnit::GetBouncePdf(const int material, const Ray newRay,
+                              const Intersection intersection) const
+{
+  if (!settings.directLighting || !scene.IsDiffuse(material)) return 0.0f;
+
+  return std::abs(Dot(newRay.direction, intersection.normal))
+       / static_cast<float>(pi);
+}
+
+Ray TraceUnit::Scatter(const int material, const Ray ray,
+                       const Spectrum wavelengths,
+                       const Intersection intersection, Spectrum& intensity,
+                       bool& dispersed, float& continueChance)
+{
+  Ray newRay = scene.GetNewRay(material, ray, intersection, monteCarloUnit);
+
+  if (dispersed)
+  {
+    // Only the hero wavelength is left
+    intensity[0] *= newRay.probability;
+  }
+  else if (scene.IsDispersive(material))
+  {
+    // The new ray is right for the hero wavelength only, so the other
+    // wavelengths end here. The hero wavelength on its own is as good
+    // an estimate as all of them together, so it takes their weight.
+    const float heroIntensity = intensity[0] * newRay.probability
+                              * Spectrum::size;
+    intensity = MakeSpectrum(0.0f);
+    intensity[0] = heroIntensity;
+    dispersed = true;
+  }
+  else
+  {
+    // All wavelengths follow the same ray
+    intensity *= scene.GetProbabilities(material, ray, intersection, newRay,
+                                        wavelengths);
+  }
+
+  // Displace the origin slightly off the surface, so the new ray won't
+  // intersect the same point
+  newRay.origin = GetRayOrigin(newRay.origin, intersection.normal,
+                               newRay.direction);
+
+  // And the chance of a new bounce decreases slightly
+  continueChance *= 0.96f;
+
+  return newRay;
+}
+
+int TraceUnit::GetContinuations(Spectrum& intensity,
+                                const float continueChance,
+                                const int depth)
+{
+  // The old estimator knows no minimum or maximum depth, the falling
+  // continue chance ends every path eventually
+  if (settings.roulette == RenderSettings::HeuristicRoulette)
+    return SurvivesRussianRoulette(intensity, continueChance) ? 1 : 0;
 
-    // Displace the origin slightly, so the new ray won't intersect the
-    // same point
-    ray.origin = ray.origin + ray.direction * 0.00001f;
+  if (depth >= settings.maxDepth) return 0;
 
-    // And the chance of a new bounce decreases slightly
-    continueChance *= 0.96f;
+  // The throughput is that of the brightest wavelength, so a path that
+  // carries mostly one colour is not ended for the others. Paths that
+  // carry no light need not continue at all.
+  const float throughput = *std::max_element(intensity.values,
+                                             intensity.values
+                                             + Spectrum::size);
+  if (throughput <= 0.0f) return 0;
+
+  // Paths that carry much more light than a camera ray, such as the
+  // hero wavelength after dispersion, are split into paths that each
+  // carry part of it
+  if (settings.splitting && throughput >= 2.0f)
+  {
+    const int copies = std::min(maxSplits, static_cast<int>(throughput));
+    intensity = intensity * (1.0f / copies);
+    return copies;
   }
+
+  if (depth < settings.minDepth || throughput >= 1.0f) return 1;
+
+  // Continue with a chance equal to the throughput, so that the paths
+  // that survive carry as much light as a camera ray
+  if (monteCarloUnit.GetUnit() >= throughput) return 0;
+
+  intensity = intensity * (1.0f / throughput);
+  return 1;
+}
+
+bool TraceUnit::SurvivesBounce(const Spectrum previousThroughput,
+                               Spectrum& throughput, const int depth)
+{
+  const float before = *std::max_element(previousThroughput.values,
+    previousThroughput.values + Spectrum::size);
+  const float after = *std::max_element(throughput.values,
+    throughput.values + Spectrum::size);
+  if (after <= 0.0f) return false;
+  if (depth <= settings.minDepth) return true;
+
+  const float chance = std::min(1.0f, after / before);
+  if (monteCarloUnit.GetUnit() >= chance) return false;
+
+  throughput = throughput * (1.0f / chance);
+  return true;
+}
+
+bool TraceUnit::SurvivesRussianRoulette(const Spectrum intensity,
+                                        const float continueChance)
+{
   // Use a sharp falloff based on intensity, so an intensity of
   // 0.1 still has 86% chance of continuing, but an intensity of
   // 0.01 has only 18% chance of continuing
-  while (monteCarloUnit.GetUnit() * 0.85f < continueChance
-         * (1.0f - std::exp(intensity * -20.0f)));
+  return monteCarloUnit.GetUnit() * 0.85f < continueChance
+         * (1.0f - std::exp(GetAverage(intensity) * -20.0f));
+}
+
+Spectrum TraceUnit::RenderBidirectional(const Ray ray, const int primitive,
+                                        const Intersection intersection,
+                                        const float time)
+{
+  const Spectrum wavelengths
+    = wavelengthDistribution.GetWavelengths(ray.wavelength);
+  const Camera camera = scene.GetCameraAtTime(time);
+
+  // The camera path starts at the lens, where the ray starts
+  PathVertex lens;
+  lens.intersection.position = ray.origin;
+  lens.primitive = -1;
+  lens.material = -1;
+  lens.throughput = MakeSpectrum(1.0f);
+  lens.dispersed = false;
+  lens.isConnectable = true;
+  lens.pdfForward = 0.0f;
+  lens.pdfReverse = 0.0f;
+  cameraVertices.clear();
+  cameraVertices.push_back(lens);
+
+  // A path of n vertices has n - 2 bounces, of which there may be no
+  // more than the maximum depth; the light path has no lens
+  const float screenArea = 4.0f / aspectRatio;
+  ExtendPath(cameraVertices, ray, primitive, intersection,
+             camera.GetScreenDensity(ray) / screenArea, MakeSpectrum(1.0f),
+             false, wavelengths, settings.maxDepth + 2, true);
+
+  // The light path starts at a point on a light
+  lightVertices.clear();
+  CompiledScene::Emission emission;
+  if (scene.SampleEmission(monteCarloUnit, emission))
+  {
+    PathVertex origin;
+    origin.intersection.position = emission.position;
+    origin.intersection.normal = emission.normal;
+    origin.primitive = emission.primitive;
+    origin.material = emission.material;
+    origin.throughput = scene.GetIntensities(emission.material, wavelengths)
+                      * (1.0f / emission.areaPdf);
+    origin.dispersed = false;
+    origin.isConnectable = true;
+    origin.pdfForward = emission.areaPdf;
+    origin.pdfReverse = 0.0f;
+    lightVertices.push_back(origin);
+
+    Ray lightRay;
+    lightRay.origin = GetRayOrigin(emission.position, emission.normal,
+                                   emission.direction);
+    lightRay.direction = emission.direction;
+    lightRay.wavelength = ray.wavelength;
+    lightRay.probability = 1.0f;
+    Intersection lightIntersection;
+    const int lightPrimitive = scene.Intersect(lightRay, lightIntersection);
+    const float cosTheta = std::abs(Dot(emission.direction,
+                                        emission.normal));
+    ExtendPath(lightVertices, lightRay, lightPrimitive, lightIntersection,
+               emission.directionPdf, origin.throughput * (cosTheta
+               / emission.directionPdf), false, wavelengths,
+               settings.maxDepth + 1, false);
+  }
+
+  const int numberOfCameraVertices = static_cast<int>(cameraVertices.size());
+  const int numberOfLightVertices = static_cast<int>(lightVertices.size());
+
+  // Connect every camera vertex to every light vertex, or take the
+  // light that the camera path hit
+  Spectrum light = MakeSpectrum(0.0f);
+  for (int t = 2; t <= numberOfCameraVertices; t++)
+  {
+    if (scene.IsEmissive(cameraVertices[t - 1].material))
+    {
+      light += Connect(0, t, wavelengths);
+      continue;
+    }
+
+    for (int s = 1; s <= numberOfLightVertices; s++)
+    {
+      if (s + t - 2 > settings.maxDepth) break;
+      light += Connect(s, t, wavelengths);
+    }
+  }
+
+  // And connect every light vertex to the lens, which puts it somewhere
+  // else on the screen
+  const Vector3 lensPoint = camera.GetLensPoint(monteCarloUnit);
+  for (int s = 1; s <= numberOfLightVertices; s++)
+  {
+    ConnectToCamera(s, camera, lensPoint, ray.wavelength);
+  }
+
+  return light;
+}
+
+void TraceUnit::ExtendPath(std::vector<PathVertex>& vertices, Ray ray,
+                           int primitive, Intersection intersection,
+                           float directionPdf, Spectrum throughput,
+                           bool dispersed, const Spectrum wavelengths,
+                           const int maxVertices, const bool isCameraPath)
+{
+  while (primitive != -1)
+  {
+    PathVertex vertex;
+    vertex.intersection = intersection;
+    vertex.incoming = ray.direction;
+    vertex.primitive = primitive;
+    vertex.material = scene.primitives[primitive].material;
+    vertex.throughput = throughput;
+    vertex.dispersed = dispersed;
+    vertex.pdfForward = GetAreaPdf(directionPdf, ray.origin, vertex);
+    vertex.pdfReverse = 0.0f;
+
+    // Lights absorb all light that arrives, they are only the end of a
+    // camera path
+    const bool isEmissive = scene.IsEmissive(vertex.material);
+    if (isEmissive && !isCameraPath) return;
+
+    vertex.isConnectable = isEmissive
+      ? scene.GetEmissionPdf(primitive) > 0.0f
+      : scene.IsDiffuse(vertex.material);
+    vertices.push_back(vertex);
+
+    if (isEmissive) return;
+    if (static_cast<int>(vertices.size()) >= maxVertices) return;
+
+    // Continue the path in the same way as a camera path does
+    const Spectrum previousThroughput = throughput;
+    float continueChance = 1.0f;
+    const Ray newRay = Scatter(vertex.material, ray, wavelengths,
+                               intersection, throughput, dispersed,
+                               continueChance);
+    directionPdf = GetDirectionPdf(vertex, newRay.direction);
+
+    // Now that the vertex is known, the previous one could have been
+    // picked from it as well
+    const int n = static_cast<int>(vertices.size());
+    vertices[n - 2].pdfReverse = GetAreaPdf(
+      GetDirectionPdf(vertex, -ray.direction),
+      intersection.position, vertices[n - 2]);
+
+    if (!SurvivesBounce(previousThroughput, throughput, n)) return;
+
+    ray = newRay;
+    primitive = scene.Intersect(ray, intersection);
+  }
+}
+
+Spectrum TraceUnit::Connect(const int s, const int t,
+                            const Spectrum wavelengths)
+{
+  const PathVertex& z = cameraVertices[t - 1];
+
+  // The camera path found a light by itself
+  if (s == 0)
+  {
+    const Spectrum emitted = z.throughput
+      * scene.GetIntensities(z.material, wavelengths);
+
+    // If the light cannot be sampled, there is no other way
+    if (!z.isConnectable) return emitted;
+
+    const PathVertex& previous = cameraVertices[t - 2];
+    const float cameraBeforeEndPdf = GetAreaPdf(
+      GetDirectionPdf(z, -z.incoming), z.intersection.position, previous);
+    return emitted * GetConnectionWeight(0, t,
+      scene.GetEmissionPdf(z.primitive), cameraBeforeEndPdf, 0.0f, 0.0f);
+  }
+
+  const PathVertex& y = lightVertices[s - 1];
+  if (!y.isConnectable || !z.isConnectable) return MakeSpectrum(0.0f);
+
+  Vector3 direction = y.intersection.position - z.intersection.position;
+  const float distanceSquared = direction.MagnitudeSquared();
+  const float distance = std::sqrt(distanceSquared);
+  direction = direction * (1.0f / distance);
+
+  const float geometry = std::abs(Dot(direction, z.intersection.normal))
+                       * std::abs(Dot(direction, y.intersection.normal))
+                       / distanceSquared;
+  Spectrum contribution = y.throughput * Evaluate(y, -direction, wavelengths)
+                        * z.throughput * Evaluate(z, direction, wavelengths)
+                        * geometry;
+
+  // Both paths take the weight of all wavelengths once for the hero
+  // wavelength, but the connected path must do so only once
+  if (y.dispersed && z.dispersed)
+    contribution = contribution * (1.0f / Spectrum::size);
+
+  if (*std::max_element(contribution.values,
+                        contribution.values + Spectrum::size) <= 0.0f)
+    return MakeSpectrum(0.0f);
+
+  Ray shadowRay;
+  shadowRay.origin = GetRayOrigin(z.intersection.position,
+                                  z.intersection.normal, direction);
+  shadowRay.direction = direction;
+  shadowRay.wavelength = wavelengths[0];
+  shadowRay.probability = 1.0f;
+  if (scene.IsOccluded(shadowRay, distance * 0.999f))
+    return MakeSpectrum(0.0f);
+
+  // The vertices on either side of the connection could have been
+  // picked from across it
+  const float cameraEndPdf = GetAreaPdf(GetDirectionPdf(y, -direction),
+                                        y.intersection.position, z);
+  const float cameraBeforeEndPdf = t > 2
+    ? GetAreaPdf(GetDirectionPdf(z, -z.incoming), z.intersection.position,
+                 cameraVertices[t - 2])
+    : 0.0f;
+  const float lightEndPdf = GetAreaPdf(GetDirectionPdf(z, direction),
+                                       z.intersection.position, y);
+  const float lightBeforeEndPdf = s > 1
+    ? GetAreaPdf(GetDirectionPdf(y, -y.incoming), y.intersection.position,
+                 lightVertices[s - 2])
+    : 0.0f;
+
+  return contribution * GetConnectionWeight(s, t, cameraEndPdf,
+    cameraBeforeEndPdf, lightEndPdf, lightBeforeEndPdf);
+}
+
+void TraceUnit::ConnectToCamera(const int s, const Camera& camera,
+                                const Vector3 lensPoint,
+                                const float wavelength)
+{
+  const PathVertex& y = lightVertices[s - 1];
+  if (!y.isConnectable) return;
+
+  MappedPhoton photon;
+  float screenDensity;
+  if (!camera.Project(y.intersection.position, lensPoint, wavelength,
+                      photon.x, photon.y, screenDensity)) return;
+  if (std::abs(photon.x) > 1.0f || std::abs(photon.y * aspectRatio) > 1.0f)
+    return;
+
+  const Vector3 lens = camera.position
+                     + Rotate(lensPoint, camera.orientation);
+  Vector3 direction = lens - y.intersection.position;
+  const float distanceSquared = direction.MagnitudeSquared();
+  const float distance = std::sqrt(distanceSquared);
+  direction = direction * (1.0f / distance);
+
+  // A camera path picks a point on the screen uniformly, so the photon
+  // counts as much as a camera path with the density of the screen
+  // position, per unit area at the vertex
+  const float screenArea = 4.0f / aspectRatio;
+  const float cameraPdf = screenDensity / screenArea
+    * std::abs(Dot(direction, y.intersection.normal)) / distanceSquared;
+
+  const Spectrum wavelengths
+    = wavelengthDistribution.GetWavelengths(wavelength);
+  photon.probability = y.throughput * Evaluate(y, direction, wavelengths)
+                     * cameraPdf;
+  if (*std::max_element(photon.probability.values,
+                        photon.probability.values + Spectrum::size) <= 0.0f)
+    return;
+
+  Ray shadowRay;
+  shadowRay.origin = GetRayOrigin(y.intersection.position,
+                                  y.intersection.normal, direction);
+  shadowRay.direction = direction;
+  shadowRay.wavelength = wavelength;
+  shadowRay.probability = 1.0f;
+  if (scene.IsOccluded(shadowRay, distance * 0.999f)) return;
+
+  const float lightBeforeEndPdf = s > 1
+    ? GetAreaPdf(GetDirectionPdf(y, -y.incoming), y.intersection.position,
+                 lightVertices[s - 2])
+    : 0.0f;
+  photon.probability = photon.probability
+    * GetConnectionWeight(s, 1, 0.0f, 0.0f, cameraPdf, lightBeforeEndPdf);
+  photon.wavelength = wavelength;
+  lightPhotons.push_back(photon);
+}
+
+// Returns the square of the density, or one if the density is not
+// known, which is marked by zero.
+inline float SquarePdf(const float pdf)
+{
+  return pdf == 0.0f ? 1.0f : pdf * pdf;
+}
+
+float TraceUnit::GetConnectionWeight(const int s, const int t,
+                                     const float cameraEndPdf,
+                                     const float cameraBeforeEndPdf,
+                                     const float lightEndPdf,
+                                     const float lightBeforeEndPdf) const
+{
+  // The density of the path for every other way to connect it, relative
+  // to this one, follows from moving the connection one vertex at a
+  // time. A way counts only if the vertices on either side of its
+  // connection can be connected. The density of a vertex that follows
+  // a material that is not diffuse is not known, so it counts as one.
+  float sum = 0.0f;
+  float ratio = 1.0f;
+  for (int i = t - 1; i > 0; i--)
+  {
+    const float reversePdf = i == t - 1 ? cameraEndPdf
+                           : i == t - 2 ? cameraBeforeEndPdf
+                           : cameraVertices[i].pdfReverse;
+    ratio *= SquarePdf(reversePdf) / SquarePdf(cameraVertices[i].pdfForward);
+    if (cameraVertices[i].isConnectable
+        && cameraVertices[i - 1].isConnectable) sum += ratio;
+  }
+
+  ratio = 1.0f;
+  for (int i = s - 1; i >= 0; i--)
+  {
+    const float reversePdf = i == s - 1 ? lightEndPdf
+                           : i == s - 2 ? lightBeforeEndPdf
+                           : lightVertices[i].pdfReverse;
+    ratio *= SquarePdf(reversePdf) / SquarePdf(lightVertices[i].pdfForward);
+    if (lightVertices[i].isConnectable
+        && (i == 0 || lightVertices[i - 1].isConnectable)) sum += ratio;
+  }
+
+  return 1.0f / (1.0f + sum);
+}
+
+float TraceUnit::GetDirectionPdf(const PathVertex& vertex,
+                                 const Vector3 direction) const
+{
+  if (scene.IsEmissive(vertex.material))
+  {
+    return scene.GetEmissionDirectionPdf(vertex.primitive,
+                                         vertex.intersection.normal,
+                                         direction);
+  }
+
+  // The density of other materials is not known, but they cannot be
+  // connected anyway, see SquarePdf
+  if (!scene.IsDiffuse(vertex.material)) return 0.0f;
+
+  return std::abs(Dot(direction, vertex.intersection.normal))
+       / static_cast<float>(pi);
+}
+
+float TraceUnit::GetAreaPdf(const float directionPdf,
+                            const Vector3 position,
+                            const PathVertex& vertex) const
+{
+  const Vector3 offset = vertex.intersection.position - position;
+  const float distanceSquared = offset.MagnitudeSquared();
+  if (distanceSquared == 0.0f) return 0.0f;
+
+  // The lens has no orientation
+  if (vertex.primitive == -1) return directionPdf / distanceSquared;
+
+  return directionPdf * std::abs(Dot(offset, vertex.intersection.normal))
+       / (distanceSquared * std::sqrt(distanceSquared));
+}
+
+Spectrum TraceUnit::Evaluate(const PathVertex& vertex,
+                             const Vector3 direction,
+                             const Spectrum wavelengths) const
+{
+  // The throughput of a light already includes what it emits, the
+  // same in every direction it emits in
+  if (scene.IsEmissive(vertex.material))
+  {
+    return MakeSpectrum(GetDirectionPdf(vertex, direction) > 0.0f
+                        ? 1.0f : 0.0f);
+  }
+
+  // A diffuse surface reflects to the side that light arrived from
+  if (Dot(direction, vertex.intersection.normal)
+      * Dot(vertex.incoming, vertex.intersection.normal) >= 0.0f)
+    return MakeSpectrum(0.0f);
+
+  return scene.GetReflectances(vertex.material, wavelengths)
+       * (1.0f / static_cast<float>(pi));
+}
+
+void TraceUnit::Locate(PhotonMapUnit& photonMapUnit, const int band)
+{
+  const int width = photonMapUnit.imageWidth;
+  const int height = photonMapUnit.imageHeight;
+  const int firstRow = band * PhotonMapUnit::rowsPerBand;
+  const int endRow = std::min(height, firstRow + PhotonMapUnit::rowsPerBand);
+
+  // All paths of the iteration carry the same wavelengths. Chromatic
+  // aberration is right for the hero wavelength only.
+  const Spectrum wavelengths = photonMapUnit.wavelengths;
+
+  for (int py = firstRow; py < endRow; py++)
+  {
+    for (int px = 0; px < width; px++)
+    {
+      // Every pixel takes its dimensions in the same order: the position
+      // within the pixel, the time, and then the lens position
+      float s[3];
+      monteCarloUnit.SetStream(batch, (py - firstRow) * width + px);
+      monteCarloUnit.FillUnit(s, 3);
+
+      const float x = (px + s[0] - 0.5f) / (width - 1) * 2.0f - 1.0f;
+      const float y = ((py + s[1] - 0.5f) / (height - 1) * 2.0f - 1.0f)
+                    / aspectRatio;
+      const Camera camera = scene.GetCameraAtTime(s[2]);
+      Ray ray = camera.GetRay(x, y, wavelengths[0], monteCarloUnit);
+
+      PhotonMapUnit::VisiblePoint& point
+        = photonMapUnit.visiblePoints[py * width + px];
+      point.isValid = false;
+      point.dispersed = false;
+      point.distance = 0.0f;
+
+      // Follow the ray through specular bounces, until it hits a diffuse
+      // surface, where the photons will be gathered, or a light
+      Spectrum throughput = MakeSpectrum(1.0f);
+      Spectrum light = MakeSpectrum(0.0f);
+      float continueChance = 1.0f;
+      for (int depth = 0; depth <= settings.maxDepth; depth++)
+      {
+        Intersection intersection;
+        const int primitive = scene.Intersect(ray, intersection);
+        if (primitive == -1) break;
+
+        point.distance += intersection.distance;
+        const int material = scene.primitives[primitive].material;
+
+        if (scene.IsEmissive(material))
+        {
+          light = throughput * scene.GetIntensities(material, wavelengths);
+          break;
+        }
+
+        if (scene.IsDiffuse(material))
+        {
+          point.position = intersection.position;
+          point.normal = intersection.normal;
+          point.incoming = ray.direction;
+          point.throughput = throughput
+            * scene.GetReflectances(material, wavelengths)
+            * (1.0f / static_cast<float>(pi));
+          point.isValid = true;
+          break;
+        }
+
+        ray = Scatter(material, ray, wavelengths, intersection, throughput,
+                      point.dispersed, continueChance);
+      }
 
-  // If Russian roulette terminated the path,
-  // there is always an option of trying direct illumination,
-  // which could be implemented here,
-  // but is not
+      photonMapUnit.directLight[py * width + px]
+        = photonMapUnit.GetTristimulus(light);
+    }
+  }
+
+  batch++;
+}
+
+void TraceUnit::EmitPhotons(PhotonMapUnit& photonMapUnit)
+{
+  const Spectrum wavelengths = photonMapUnit.wavelengths;
+
+  for (int i = 0; i < numberOfPaths; i++)
+  {
+    monteCarloUnit.SetStream(batch, i);
+
+    CompiledScene::Emission emission;
+    if (!scene.SampleEmission(monteCarloUnit, emission)) continue;
+
+    const float cosTheta = std::abs(Dot(emission.direction, emission.normal));
+    Spectrum throughput = scene.GetIntensities(emission.material, wavelengths)
+      * (cosTheta / (emission.areaPdf * emission.directionPdf));
+    bool dispersed = false;
+    float continueChance = 1.0f;
+
+    Ray ray;
+    ray.origin = GetRayOrigin(emission.position, emission.normal,
+                              emission.direction);
+    ray.direction = emission.direction;
+    ray.wavelength = wavelengths[0];
+    ray.probability = 1.0f;
+
+    for (int depth = 0; ; depth++)
+    {
+      Intersection intersection;
+      const int primitive = scene.Intersect(ray, intersection);
+      if (primitive == -1) break;
+
+      // Lights absorb all light that arrives
+      const int material = scene.primitives[primitive].material;
+      if (scene.IsEmissive(material)) break;
+
+      // Only diffuse surfaces keep photons, the camera sees through the
+      // others by itself
+      if (scene.IsDiffuse(material))
+      {
+        photonMapUnit.AddPhoton(intersection.position, ray.direction,
+                                throughput, dispersed);
+      }
+
+      if (depth >= settings.maxDepth) break;
+
+      const Spectrum previousThroughput = throughput;
+      ray = Scatter(material, ray, wavelengths, intersection, throughput,
+                    dispersed, continueChance);
+      if (!SurvivesBounce(previousThroughput, throughput, depth + 1)) break;
+    }
+  }
+
+  photonMapUnit.AddEmittedPhotons(numberOfPaths);
+  batch++;
+}
+
+void TraceUnit::RenderWavefront(PlotUnit* plotUnit)
+{
+  paths.materialQueues.resize(scene.materials.size());
+
+  for (int begin = 0; begin < numberOfPaths; begin += wavefrontSize)
+  {
+    // Photons only need to last until all paths in flight have ended,
+    // then they are plotted or packed
+    MappedPhoton* const photons = wavefrontPhotons.data();
+    const int size = std::min(wavefrontSize, numberOfPaths - begin);
+
+    // Paths that were split are appended, so drop those of the
+    // previous batch of paths
+    paths.origins.resize(size);
+    paths.directions.resize(size);
+    paths.intersections.resize(size);
+    paths.wavelengths.resize(size);
+    paths.intensities.resize(size);
+    paths.continueChances.resize(size);
+    paths.dispersed.resize(size);
+    paths.bouncePdfs.resize(size);
+    paths.depths.resize(size);
+    paths.randomPositions.resize(size);
+    paths.photonIndices.resize(size);
+
+    // Start all paths at the camera, and trace the first bounce in
+    // packets
+    for (int i = 0; i < size; i += packetSize)
+    {
+      const int n = std::min(packetSize, size - i);
+      Ray rays[packetSize];
+      int primitives[packetSize];
+      GenerateCameraPacket(photons + i, begin + i, n, rays,
+                           &paths.randomPositions[i], nullptr);
+      scene.IntersectPacket(rays, n, &paths.intersections[i], primitives);
+
+      for (int j = 0; j < n; j++)
+      {
+        paths.origins[i + j] = rays[j].origin;
+        paths.directions[i + j] = rays[j].direction;
+        paths.wavelengths[i + j]
+          = wavelengthDistribution.GetWavelengths(rays[j].wavelength);
+        paths.intensities[i + j] = MakeSpectrum(1.0f);
+        paths.continueChances[i + j] = 1.0f;
+        paths.dispersed[i + j] = false;
+        paths.bouncePdfs[i + j] = 0.0f;
+        paths.depths[i + j] = 0;
+        paths.photonIndices[i + j] = i + j;
+        photons[i + j].probability = MakeSpectrum(0.0f);
+        QueuePath(photons[i + j], i + j, primitives[j]);
+      }
+    }
+
+    // Then advance them all one bounce at a time, until all have ended
+    for (;;)
+    {
+      ShadePaths(photons, begin);
+      if (paths.active.empty()) break;
+      IntersectPaths(photons);
+    }
+
+    // Only the photons that carry light are kept, weighted by their
+    // packet
+    int kept = 0;
+    for (int i = 0; i < size; i += packetSize)
+    {
+      kept += CompactPhotons(photons + i, std::min(packetSize, size - i),
+                             packetWeights[(begin + i) / packetSize],
+                             photons + kept);
+    }
+
+    if (plotUnit)
+    {
+      const Camera camera = scene.GetCameraAtTime(0.0f);
+      plotUnit->PlotPhotons(photons, kept, camera, wavelengthDistribution);
+    }
+    else PackPhotons(photons, kept);
+
+    numberOfPhotons += kept;
+  }
+}
+
+void TraceUnit::IntersectPaths(MappedPhoton* photons)
+{
+  for (int i : paths.active)
+  {
+    Ray ray;
+    ray.origin = paths.origins[i];
+    ray.direction = paths.directions[i];
+    ray.wavelength = paths.wavelengths[i][0];
+    ray.probability = 1.0f;
+
+    const int primitive = scene.Intersect(ray, paths.intersections[i]);
+    QueuePath(photons[paths.photonIndices[i]], i, primitive);
+  }
+
+  paths.active.clear();
+}
+
+void TraceUnit::QueuePath(MappedPhoton& photon, const int path,
+                          const int primitive)
+{
+  // Paths that escape into The Void or hit a light end here
+  if (primitive == -1) return;
+
+  const int material = scene.primitives[primitive].material;
+  if (scene.IsEmissive(material))
+  {
+    Ray ray;
+    ray.origin = paths.origins[path];
+    ray.direction = paths.directions[path];
+    ray.wavelength = paths.wavelengths[path][0];
+    ray.probability = 1.0f;
+
+    photon.probability += paths.intensities[path]
+      * GetBounceWeight(paths.bouncePdfs[path], primitive, ray,
+                        paths.intersections[path])
+      * scene.GetIntensities(material, paths.wavelengths[path]);
+    return;
+  }
+
+  // Others are shaded together with the paths that hit the same
+  // material
+  paths.materialQueues[material].push_back(path);
+}
+
+void TraceUnit::ShadePaths(MappedPhoton* photons, const int firstPath)
+{
+  for (size_t material = 0; material < paths.materialQueues.size(); material++)
+  {
+    std::vector<int>& queue = paths.materialQueues[material];
+    const bool directLighting = settings.directLighting
+      && scene.IsDiffuse(static_cast<int>(material));
 
-  return 0.0f;
+    for (int i : queue)
+    {
+      // Continue the random stream of the path
+      const int photon = paths.photonIndices[i];
+      monteCarloUnit.SetStream(batch, firstPath + photon,
+                               paths.randomPositions[i]);
+
+      Ray ray;
+      ray.origin = paths.origins[i];
+      ray.direction = paths.directions[i];
+      ray.wavelength = paths.wavelengths[i][0];
+      ray.probability = 1.0f;
+
+      if (directLighting)
+      {
+        photons[photon].probability += paths.intensities[i]
+          * SampleDirectLight(static_cast<int>(material), ray,
+                              paths.wavelengths[i], paths.intersections[i]);
+      }
+
+      const int continuations = GetContinuations(paths.intensities[i],
+                                                 paths.continueChances[i],
+                                                 paths.depths[i]);
+
+      // Copies of a split path scatter from the same point, with
+      // numbers from elsewhere in the stream
+      const std::uint32_t position = monteCarloUnit.GetPosition();
+      for (int j = 1; j < continuations; j++)
+      {
+        const int copy = CopyPath(i);
+        monteCarloUnit.SetPosition(GetSplitPosition(position, j));
+        ScatterPath(static_cast<int>(material), copy);
+      }
+
+      if (continuations > 0)
+      {
+        monteCarloUnit.SetPosition(position);
+        ScatterPath(static_cast<int>(material), i);
+      }
+    }
+
+    queue.clear();
+  }
+}
+
+void TraceUnit::ScatterPath(const int material, const int path)
+{
+  Ray ray;
+  ray.origin = paths.origins[path];
+  ray.direction = paths.directions[path];
+  ray.wavelength = paths.wavelengths[path][0];
+  ray.probability = 1.0f;
+
+  bool dispersed = paths.dispersed[path];
+  const Ray newRay = Scatter(material, ray, paths.wavelengths[path],
+                             paths.intersections[path],
+                             paths.intensities[path], dispersed,
+                             paths.continueChances[path]);
+  paths.dispersed[path] = dispersed;
+  paths.origins[path] = newRay.origin;
+  paths.directions[path] = newRay.direction;
+  paths.bouncePdfs[path] = GetBouncePdf(material, newRay,
+                                        paths.intersections[path]);
+  paths.depths[path]++;
+  paths.randomPositions[path] = monteCarloUnit.GetPosition();
+
+  // The path goes on to the next intersection
+  paths.active.push_back(path);
+}
+
+// Appends a copy of the element at the index to the vector, and returns
+// the index of the copy.
+template <typename T>
+int AppendCopy(std::vector<T>& vector, const int index)
+{
+  const T element = vector[index];
+  vector.push_back(element);
+  return static_cast<int>(vector.size()) - 1;
+}
+
+int TraceUnit::CopyPath(const int path)
+{
+  AppendCopy(paths.origins, path);
+  AppendCopy(paths.directions, path);
+  AppendCopy(paths.intersections, path);
+  AppendCopy(paths.wavelengths, path);
+  AppendCopy(paths.intensities, path);
+  AppendCopy(paths.continueChances, path);
+  AppendCopy(paths.dispersed, path);
+  AppendCopy(paths.bouncePdfs, path);
+  AppendCopy(paths.depths, path);
+  AppendCopy(paths.randomPositions, path);
+  return AppendCopy(paths.photonIndices, path);
 }
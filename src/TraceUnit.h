@@ -16,15 +16,22 @@
 
 #pragma once
 
+#include <vector>
 #include "MappedPhoton.h"
 #include "Ray.h"
 #include "Object.h"
 #include "Intersection.h"
 #include "MonteCarloUnit.h"
+#include "RenderSettings.h"
+#include "Spectrum.h"
+#include "WavelengthDistribution.h"
 
 namespace Luculentus
 {
-  class Scene;
+  class Camera;
+  class CompiledScene;
+  class PhotonMapUnit;
+  class PlotUnit;
 
   class TraceUnit
   {
@@ -34,11 +41,25 @@ namespace Luculentus
       MonteCarloUnit monteCarloUnit;
 
       /// The scene that will be rendered.
-      const Scene& scene;
+      const CompiledScene& scene;
 
       /// The aspect ratio of the image that will be rendered
       const float aspectRatio;
 
+      /// How much larger than the screen the area is that camera rays
+      /// start from, along either side. Chromatic aberration moves the
+      /// other wavelengths of a path closer to the centre of the screen
+      /// than the hero wavelength, so paths must start outside it for
+      /// every wavelength to cover the entire screen.
+      const float screenScale;
+
+      /// How to render
+      const RenderSettings settings;
+
+      /// How the hero wavelengths of the paths are distributed. Photons
+      /// must be weighted by it when they are plotted.
+      const WavelengthDistribution wavelengthDistribution;
+
       // Trace less paths per task in debug mode, because debug mode is
       // terribly slow
       #ifdef _DEBUG
@@ -49,26 +70,369 @@ namespace Luculentus
 
       static const int numberOfMappedPhotons = numberOfPaths;
 
-      /// The photons that were rendered
-      MappedPhoton mappedPhotons[numberOfMappedPhotons];
+      /// The number of paths that are in flight at once in wavefront
+      /// mode.
+      static const int wavefrontSize = 1024 * 64;
+
+      /// The number of strata along either side of a tile.
+      static const int strataPerSide = 4;
+
+      /// The number of camera rays that are traced as one packet. They
+      /// all go through the same small tile of the screen, one ray per
+      /// stratum of the tile.
+      static const int packetSize = strataPerSide * strataPerSide;
+
+      /// The number of tiles across the width of the screen.
+      static const int tilesPerRow = 80;
+
+      /// The largest number of paths that a path is split into at once.
+      static const int maxSplits = 4;
+
+      /// The number of tiles across the height of the screen.
+      const int tilesPerColumn;
+
+      /// The photons that were rendered, at most one per path, packed.
+      /// There is no room for them if the unit plots its photons itself,
+      /// or renders photon maps.
+      std::vector<PackedPhoton> packedPhotons;
 
-      /// Creates a new work unit that renders the specified scene,
-      /// initialized with the specified random seed
-      TraceUnit(const Scene& scn, const unsigned long randomSeed,
-                const int width, const int height);
+      /// The number of photons of the last render, at the start of the
+      /// packed photons, or plotted right away. Paths that carry no
+      /// light leave no photon, so this is less than the number of
+      /// paths. Photons are weighted by the density of their tile
+      /// already.
+      int numberOfPhotons;
+
+      /// The photons that light paths put on the screen directly in
+      /// bidirectional mode. They do not belong to a camera path, and
+      /// are not weighted by its tile.
+      std::vector<MappedPhoton> lightPhotons;
+
+      /// Creates a new work unit that renders the specified scene. Units
+      /// must have different indices, their random streams derive from
+      /// it.
+      TraceUnit(const CompiledScene& scn, const std::uint32_t unitIndex,
+                const int width, const int height,
+                const RenderSettings& renderSettings);
 
       /// Fills the buffer of mapped photons once.
       void Render();
 
+      /// Renders as many paths as Render does, but plots their photons
+      /// into the plot unit right away, instead of storing them.
+      void Render(PlotUnit& plotUnit);
+
+      /// Sets the chance that a packet goes through every tile of the
+      /// screen, row by row, for the next renders. If there are no
+      /// densities, all tiles are equally likely.
+      void SetTileDensities(const std::vector<float>& densities);
+
+      /// Finds the visible points of the photon map for a band of rows of
+      /// pixels, and the light that the camera sees through specular
+      /// bounces on the way.
+      void Locate(PhotonMapUnit& photonMapUnit, const int band);
+
+      /// Emits photons from the lights, and adds them to the photon map
+      /// wherever they hit a diffuse surface.
+      void EmitPhotons(PhotonMapUnit& photonMapUnit);
+
     private:
 
-      /// Returns the contribution of a ray through the specified screen
-      /// coordinates.
-      float RenderCameraRay(const float x, const float y,
-                            const float wavelength);
+      /// The paths in flight in wavefront mode. Every array has one
+      /// element per path, and paths are identified by their index.
+      struct PathStates
+      {
+        std::vector<Vector3> origins;
+        std::vector<Vector3> directions;
+        std::vector<Intersection> intersections;
+        std::vector<Spectrum> wavelengths;
+        std::vector<Spectrum> intensities;
+        std::vector<float> continueChances;
+
+        /// Whether only the hero wavelength is left, see Scatter.
+        std::vector<bool> dispersed;
+
+        /// See bouncePdf in RenderRay.
+        std::vector<float> bouncePdfs;
+
+        /// The number of bounces of every path so far.
+        std::vector<int> depths;
+
+        /// The position of every path in its random stream.
+        std::vector<std::uint32_t> randomPositions;
+
+        /// The photon that every path contributes to. Paths that were
+        /// split are appended after the paths that started at the
+        /// camera, and contribute to the same photon, with the same
+        /// random stream.
+        std::vector<int> photonIndices;
+
+        /// The paths that have not ended yet.
+        std::vector<int> active;
+
+        /// For every material, the paths that hit it in the current
+        /// bounce.
+        std::vector<std::vector<int>> materialQueues;
+      }
+      /// The paths in flight in wavefront mode.
+      paths;
+
+      /// A copy of a path that was split at an intersection, which has
+      /// not scattered there yet.
+      struct SplitPath
+      {
+        Ray ray;
+        Intersection intersection;
+        int material;
+        Spectrum intensity;
+        bool dispersed;
+        float continueChance;
+        int depth;
+
+        /// The position in the random stream at which the copy
+        /// continues.
+        std::uint32_t randomPosition;
+      };
+
+      /// The copies of the current path in depth-first mode that still
+      /// have to be traced.
+      std::vector<SplitPath> splitPaths;
+
+      /// A vertex of a light or camera path in bidirectional mode.
+      struct PathVertex
+      {
+        /// The position and normal of the vertex.
+        Intersection intersection;
+
+        /// The direction of the ray that arrived at the vertex.
+        Vector3 incoming;
+
+        /// The primitive at the vertex, or -1 for the lens.
+        int primitive;
+
+        /// The material of the primitive.
+        int material;
+
+        /// The light (or for camera paths, the importance) that arrives
+        /// at the vertex, divided by the density of the path so far.
+        Spectrum throughput;
+
+        /// Whether only the hero wavelength is left, see Scatter.
+        bool dispersed;
+
+        /// Whether the vertex can be connected to a vertex of the other
+        /// path: the lens, lights, and diffuse surfaces.
+        bool isConnectable;
+
+        /// The probability density per unit area with which the vertex
+        /// was picked from the previous vertex of its path, and with
+        /// which it would have been picked from the next one, walking
+        /// the path in reverse. Vertices picked by a material that is
+        /// not diffuse have a density of zero, see GetConnectionWeight.
+        float pdfForward, pdfReverse;
+      };
+
+      /// The vertices of the light path of the current path, the light
+      /// first.
+      std::vector<PathVertex> lightVertices;
+
+      /// The vertices of the camera path of the current path, the lens
+      /// first.
+      std::vector<PathVertex> cameraVertices;
+
+      /// The photons of the paths in flight in wavefront mode, before
+      /// they are packed or plotted.
+      std::vector<MappedPhoton> wavefrontPhotons;
+
+      /// For every packet of camera rays, the factor by which its photons
+      /// must be weighted, because its tile was more or less likely to be
+      /// picked than with uniform sampling.
+      std::vector<float> packetWeights;
+
+      /// See SetTileDensities.
+      std::vector<float> tileDensities;
+
+      /// The cumulative distribution of the tile densities, at the start
+      /// of every tile, and at the end of the last one.
+      std::vector<float> tileCumulative;
+
+      /// The index of this unit.
+      const std::uint32_t unit;
+
+      /// The number of times the buffer was filled. Every path has its
+      /// own random stream, identified by the batch and its index.
+      std::uint32_t batch;
+
+      /// Renders a batch of paths, and plots their photons into the plot
+      /// unit as soon as they are done, if there is one.
+      void RenderBatch(PlotUnit* plotUnit);
+
+      /// Moves the photons that carry light to the destination, which
+      /// must not come after the photons, in the same order, and weights
+      /// them. Returns the number of photons that were kept.
+      int CompactPhotons(const MappedPhoton* photons, const int count,
+                         const float weight, MappedPhoton* destination);
+
+      /// Packs the photons, and appends them to the packed photons.
+      void PackPhotons(const MappedPhoton* photons, const int count);
+
+      /// Returns the camera ray that the photon of the specified
+      /// wavelength at the specified screen position followed, at the
+      /// specified time.
+      Ray GenerateCameraRay(MappedPhoton& mappedPhoton, const float x,
+                            const float y, const float wavelength,
+                            const float t);
+
+      /// Generates camera rays for the photons at jittered positions
+      /// in the strata of a tile of the screen, so the rays can be
+      /// traced as a packet. Consecutive packets go through consecutive
+      /// tiles, or the same tile, if it is dense enough. Every path
+      /// takes its numbers from its own stream. The positions at which
+      /// the streams continue are stored, and so are the times of the
+      /// rays, if times is not null.
+      void GenerateCameraPacket(MappedPhoton* photons, const int firstPath,
+                                const int size, Ray* rays,
+                                std::uint32_t* positions, float* times);
 
       /// Retruns the contribution of a photon travelling backwards the
-      /// specified ray.
-      float RenderRay(Ray ray);
+      /// specified ray, which first hit the specified primitive, at
+      /// every wavelength of the path.
+      Spectrum RenderRay(Ray ray, int primitive, Intersection intersection);
+
+      /// Samples a light as seen from the intersection with a diffuse
+      /// material, and returns the light that the material reflects
+      /// along the ray from it, weighted for multiple importance
+      /// sampling.
+      Spectrum SampleDirectLight(const int material, const Ray ray,
+                                 const Spectrum wavelengths,
+                                 const Intersection intersection);
+
+      /// Returns the weight of light that was found by a bounce with the
+      /// specified probability density, rather than by sampling the
+      /// light that the ray hit.
+      float GetBounceWeight(const float bouncePdf, const int primitive,
+                            const Ray ray,
+                            const Intersection intersection) const;
+
+      /// Returns the density with which a diffuse bounce picks the
+      /// direction of the new ray if lights are sampled directly as
+      /// well, or zero if they are not.
+      float GetBouncePdf(const int material, const Ray newRay,
+                         const Intersection intersection) const;
+
+      /// Continues the ray after it hit a non-emissive material, and
+      /// updates the intensity and continuation chance of the path. The
+      /// new ray follows the hero wavelength. If its direction depends
+      /// on the wavelength, the path is dispersed, and carries only the
+      /// hero wavelength from then on.
+      Ray Scatter(const int material, const Ray ray,
+                  const Spectrum wavelengths,
+                  const Intersection intersection, Spectrum& intensity,
+                  bool& dispersed, float& continueChance);
+
+      /// Decides how many paths continue from an intersection at the
+      /// specified depth: none if the path ends there, or more than one
+      /// if it is split. The intensity of the path is adjusted for the
+      /// decision, and applies to every continuing path.
+      int GetContinuations(Spectrum& intensity, const float continueChance,
+                           const int depth);
+
+      /// Decides randomly whether a path of the specified depth continues
+      /// after a bounce changed its throughput, with the chance that the
+      /// bounce carried the light on, so that paths that survive carry
+      /// as much light as before. The throughput is adjusted if the path
+      /// continues.
+      bool SurvivesBounce(const Spectrum previousThroughput,
+                          Spectrum& throughput, const int depth);
+
+      /// Decides randomly whether the path continues, for heuristic
+      /// roulette.
+      bool SurvivesRussianRoulette(const Spectrum intensity,
+                                   const float continueChance);
+
+      /// Returns the contribution of the camera ray, which first hit the
+      /// specified primitive, by connecting every vertex of a camera path
+      /// that continues it to every vertex of a light path. Connections
+      /// of the light path to the lens are added to the light photons.
+      Spectrum RenderBidirectional(const Ray ray, const int primitive,
+                                   const Intersection intersection,
+                                   const float time);
+
+      /// Walks the path from its last vertex along the ray, which hit
+      /// the primitive at the intersection. Vertices are appended until
+      /// the path ends, or has the maximum number of vertices. Camera
+      /// paths end at a light, light paths end before one.
+      void ExtendPath(std::vector<PathVertex>& vertices, Ray ray,
+                      int primitive, Intersection intersection,
+                      float directionPdf, Spectrum throughput,
+                      bool dispersed, const Spectrum wavelengths,
+                      const int maxVertices, const bool isCameraPath);
+
+      /// Returns the light that the light path carries from its vertex
+      /// s - 1 to vertex t - 1 of the camera path, and on to the camera,
+      /// weighted for multiple importance sampling.
+      Spectrum Connect(const int s, const int t,
+                       const Spectrum wavelengths);
+
+      /// Connects vertex s - 1 of the light path to the lens point, and
+      /// adds the photon that it puts on the screen to the light
+      /// photons.
+      void ConnectToCamera(const int s, const Camera& camera,
+                           const Vector3 lensPoint, const float wavelength);
+
+      /// Returns the weight of the connection of vertex s - 1 of the
+      /// light path to vertex t - 1 of the camera path, among all ways to
+      /// connect the same vertices, with the power heuristic. The reverse
+      /// densities of the vertices on either side of the connection are
+      /// not stored, they depend on the connection.
+      float GetConnectionWeight(const int s, const int t,
+                                const float cameraEndPdf,
+                                const float cameraBeforeEndPdf,
+                                const float lightEndPdf,
+                                const float lightBeforeEndPdf) const;
+
+      /// Returns the density per unit solid angle with which the vertex
+      /// picks the direction of the next vertex.
+      float GetDirectionPdf(const PathVertex& vertex,
+                            const Vector3 direction) const;
+
+      /// Returns the density per unit area at the vertex, of the
+      /// specified density per unit solid angle, for a direction picked
+      /// at the position.
+      float GetAreaPdf(const float directionPdf, const Vector3 position,
+                       const PathVertex& vertex) const;
+
+      /// Returns the light that a connectable vertex sends in the
+      /// direction, for the light that arrived at it.
+      Spectrum Evaluate(const PathVertex& vertex, const Vector3 direction,
+                        const Spectrum wavelengths) const;
+
+      /// Renders a batch of paths by advancing many of them one bounce
+      /// at a time, and plots their photons into the plot unit, if there
+      /// is one.
+      void RenderWavefront(PlotUnit* plotUnit);
+
+      /// Intersects all active paths with the scene, and either ends
+      /// them, or puts them in the queue of the material they hit.
+      void IntersectPaths(MappedPhoton* photons);
+
+      /// Ends the path if it hit nothing or a light, or puts it in the
+      /// queue of the material it hit.
+      void QueuePath(MappedPhoton& photon, const int path,
+                     const int primitive);
+
+      /// Scatters the paths in the material queues, one material at a
+      /// time, and returns the survivors to the active paths. The
+      /// photons belong to the paths of the batch from the first path
+      /// on.
+      void ShadePaths(MappedPhoton* photons, const int firstPath);
+
+      /// Continues the path at its intersection with the specified
+      /// material, and makes it active again.
+      void ScatterPath(const int material, const int path);
+
+      /// Appends a copy of the state of the path, and returns the index
+      /// of the copy.
+      int CopyPath(const int path);
   };
 }
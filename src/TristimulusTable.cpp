@@ -0,0 +1,145 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "TristimulusTable.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace Luculentus;
+
+// Sizes that are passed by reference need a definition
+const int TristimulusTable::firstWavelength;
+const int TristimulusTable::size;
+const int TristimulusTable::lastIndex;
+
+TristimulusTable::TristimulusTable(const float* cieX, const float* cieY,
+                                   const float* cieZ)
+{
+  for (int i = 0; i < size; i++)
+  {
+    const float indexf = static_cast<float>(firstWavelength + i - 380) / 5.0f;
+    const int index = static_cast<int>(std::floor(indexf));
+    const float remainder = indexf - index;
+
+    // Outside of the measurements, the values fall off to zero within
+    // 5nm, and beyond that they are zero
+    const float weight0 = index >= 0 && index <= 80 ? 1.0f - remainder : 0.0f;
+    const float weight1 = index >= -1 && index < 80 ? remainder : 0.0f;
+    const int index0 = std::max(0, std::min(80, index));
+    const int index1 = std::max(0, std::min(80, index + 1));
+
+    x[i] = cieX[index0] * weight0 + cieX[index1] * weight1;
+    y[i] = cieY[index0] * weight0 + cieY[index1] * weight1;
+    z[i] = cieZ[index0] * weight0 + cieZ[index1] * weight1;
+  }
+}
+
+Vector3 TristimulusTable::GetTristimulus(const float wavelength) const
+{
+  // Wavelengths outside of the table land on a zero entry (this also
+  // takes NaN to the first entry)
+  const float indexf = std::min(static_cast<float>(lastIndex + 1),
+    std::max(0.0f, wavelength - static_cast<float>(firstWavelength)));
+  const int index = std::min(lastIndex, static_cast<int>(indexf));
+  const float remainder = indexf - index;
+
+  return MakeVector3(x[index] + (x[index + 1] - x[index]) * remainder,
+                     y[index] + (y[index + 1] - y[index]) * remainder,
+                     z[index] + (z[index + 1] - z[index]) * remainder);
+}
+
+void TristimulusTable::GetTristimuli(const float* wavelengths,
+                                     Vector3* tristimuli,
+                                     const int count) const
+{
+  int i = 0;
+
+  // The same computation as GetTristimulus, with the entries gathered
+  // for a vector of wavelengths
+  #if defined(__AVX2__)
+  {
+    const __m256 first = _mm256_set1_ps(static_cast<float>(firstWavelength));
+    const __m256 last = _mm256_set1_ps(static_cast<float>(lastIndex + 1));
+    const __m256i lastInt = _mm256_set1_epi32(lastIndex);
+    alignas(32) float cieX[8], cieY[8], cieZ[8];
+
+    for (; i + 8 <= count; i += 8)
+    {
+      const __m256 indexf = _mm256_min_ps(last, _mm256_max_ps(
+        _mm256_sub_ps(_mm256_loadu_ps(wavelengths + i), first),
+        _mm256_setzero_ps()));
+      const __m256i index = _mm256_min_epi32(lastInt,
+                                             _mm256_cvttps_epi32(indexf));
+      const __m256 remainder = _mm256_sub_ps(indexf,
+                                             _mm256_cvtepi32_ps(index));
+
+      const __m256 x0 = _mm256_i32gather_ps(x, index, 4);
+      const __m256 y0 = _mm256_i32gather_ps(y, index, 4);
+      const __m256 z0 = _mm256_i32gather_ps(z, index, 4);
+      const __m256 x1 = _mm256_i32gather_ps(x + 1, index, 4);
+      const __m256 y1 = _mm256_i32gather_ps(y + 1, index, 4);
+      const __m256 z1 = _mm256_i32gather_ps(z + 1, index, 4);
+
+      _mm256_store_ps(cieX, _mm256_add_ps(x0,
+        _mm256_mul_ps(_mm256_sub_ps(x1, x0), remainder)));
+      _mm256_store_ps(cieY, _mm256_add_ps(y0,
+        _mm256_mul_ps(_mm256_sub_ps(y1, y0), remainder)));
+      _mm256_store_ps(cieZ, _mm256_add_ps(z0,
+        _mm256_mul_ps(_mm256_sub_ps(z1, z0), remainder)));
+
+      for (int j = 0; j < 8; j++)
+        tristimuli[i + j] = MakeVector3(cieX[j], cieY[j], cieZ[j]);
+    }
+
+    // A spectrum has four wavelengths, so those get a narrower vector
+    for (; i + 4 <= count; i += 4)
+    {
+      const __m128 indexf = _mm_min_ps(_mm256_castps256_ps128(last),
+        _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(wavelengths + i),
+                              _mm256_castps256_ps128(first)),
+                   _mm_setzero_ps()));
+      const __m128i index = _mm_min_epi32(_mm256_castsi256_si128(lastInt),
+                                          _mm_cvttps_epi32(indexf));
+      const __m128 remainder = _mm_sub_ps(indexf, _mm_cvtepi32_ps(index));
+
+      const __m128 x0 = _mm_i32gather_ps(x, index, 4);
+      const __m128 y0 = _mm_i32gather_ps(y, index, 4);
+      const __m128 z0 = _mm_i32gather_ps(z, index, 4);
+      const __m128 x1 = _mm_i32gather_ps(x + 1, index, 4);
+      const __m128 y1 = _mm_i32gather_ps(y + 1, index, 4);
+      const __m128 z1 = _mm_i32gather_ps(z + 1, index, 4);
+
+      _mm_store_ps(cieX, _mm_add_ps(x0,
+        _mm_mul_ps(_mm_sub_ps(x1, x0), remainder)));
+      _mm_store_ps(cieY, _mm_add_ps(y0,
+        _mm_mul_ps(_mm_sub_ps(y1, y0), remainder)));
+      _mm_store_ps(cieZ, _mm_add_ps(z0,
+        _mm_mul_ps(_mm_sub_ps(z1, z0), remainder)));
+
+      for (int j = 0; j < 4; j++)
+        tristimuli[i + j] = MakeVector3(cieX[j], cieY[j], cieZ[j]);
+    }
+  }
+  #endif
+
+  // The remainder one at a time
+  for (; i < count; i++) tristimuli[i] = GetTristimulus(wavelengths[i]);
+}
@@ -0,0 +1,61 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  /// The tristimulus values of a colour matching function, resampled at
+  /// 1nm intervals, with zeros on both sides of the visible spectrum.
+  /// Wavelengths are clamped to the table, so a lookup is the same
+  /// interpolation for every wavelength, which makes it cheap to do for
+  /// many wavelengths at once.
+  class TristimulusTable
+  {
+    private:
+
+      /// The wavelength of the first entry (in nm).
+      static const int firstWavelength = 374;
+
+      /// The number of entries, of which the last few are zero.
+      static const int size = 416;
+
+      /// The index of the last entry that is interpolated from.
+      static const int lastIndex = 411;
+
+      /// CIE XYZ tristimulus values, at 1nm intervals, starting at
+      /// firstWavelength.
+      float x[size], y[size], z[size];
+
+    public:
+
+      /// Resamples tristimulus values that are given at 5nm intervals,
+      /// starting at 380nm, like the tables of Cie1931 and Cie1964.
+      TristimulusTable(const float* cieX, const float* cieY,
+                       const float* cieZ);
+
+      /// Returns the tristimulus values at the wavelength, or zero if
+      /// the wavelength is not in the visible spectrum.
+      Vector3 GetTristimulus(const float wavelength) const;
+
+      /// Stores the tristimulus values of count wavelengths, see
+      /// GetTristimulus.
+      void GetTristimuli(const float* wavelengths, Vector3* tristimuli,
+                         const int count) const;
+  };
+}
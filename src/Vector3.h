@@ -123,6 +123,22 @@ namespace Luculentus
     return a - normal * 2.0f * Dot(normal, a);
   }
 
+  /// Returns the component-wise minimum of two vectors.
+  inline Vector3 Min(const Vector3 a, const Vector3 b)
+  {
+    Vector3 min = { std::fmin(a.x, b.x), std::fmin(a.y, b.y),
+                    std::fmin(a.z, b.z) };
+    return min;
+  }
+
+  /// Returns the component-wise maximum of two vectors.
+  inline Vector3 Max(const Vector3 a, const Vector3 b)
+  {
+    Vector3 max = { std::fmax(a.x, b.x), std::fmax(a.y, b.y),
+                    std::fmax(a.z, b.z) };
+    return max;
+  }
+
   /// Constructs a vector with the specified components.
   inline Vector3 MakeVector3(const float x, const float y, const float z)
   {
@@ -0,0 +1,134 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "WavelengthDistribution.h"
+
+#include <algorithm>
+#include <cmath>
+#include "Cie1931.h"
+#include "CompiledScene.h"
+
+using namespace Luculentus;
+
+WavelengthDistribution::WavelengthDistribution(const CompiledScene& scene,
+  const RenderSettings::WavelengthSampling sampling)
+{
+  // The spectrum of all lights together, where every light counts
+  // equally, regardless of its intensity
+  float lights[numberOfBins];
+  std::fill(lights, lights + numberOfBins, 0.0f);
+
+  if (sampling == RenderSettings::ObserverAndLightWavelengths)
+  {
+    for (size_t m = 0; m < scene.materials.size(); m++)
+    {
+      const int material = static_cast<int>(m);
+      if (!scene.IsEmissive(material)) continue;
+
+      float intensities[numberOfBins];
+      float sum = 0.0f;
+      for (int i = 0; i < numberOfBins; i++)
+      {
+        intensities[i] = scene.GetIntensity(material, 380.5f + i);
+        sum += intensities[i];
+      }
+
+      if (sum <= 0.0f) continue;
+      for (int i = 0; i < numberOfBins; i++) lights[i] += intensities[i] / sum;
+    }
+  }
+
+  // Without lights, the density is proportional to the sensitivity of
+  // the observer alone
+  if (*std::max_element(lights, lights + numberOfBins) <= 0.0f)
+    std::fill(lights, lights + numberOfBins, 1.0f);
+
+  float sum = 0.0f;
+  for (int i = 0; i < numberOfBins; i++)
+  {
+    float density = 1.0f;
+
+    if (sampling != RenderSettings::UniformWavelengths)
+    {
+      const Vector3 cie = Cie1931::GetTristimulus(380.5f + i);
+      density = (cie.x + cie.y + cie.z) * lights[i];
+    }
+
+    densities[i] = density;
+    sum += density;
+  }
+
+  // Normalise the densities, and accumulate them
+  cumulative[0] = 0.0f;
+  for (int i = 0; i < numberOfBins; i++)
+  {
+    densities[i] /= sum;
+    cumulative[i + 1] = cumulative[i] + densities[i];
+  }
+  cumulative[numberOfBins] = 1.0f;
+}
+
+int WavelengthDistribution::GetBin(const float wavelength) const
+{
+  const int bin = static_cast<int>(std::floor(wavelength - 380.0f));
+  return std::max(0, std::min(numberOfBins - 1, bin));
+}
+
+float WavelengthDistribution::Sample(const float unit) const
+{
+  // Find the bin in which the cumulative distribution passes the unit,
+  // and then the position within the bin
+  const float* end = std::upper_bound(cumulative + 1,
+                                      cumulative + numberOfBins, unit);
+  const int bin = static_cast<int>(end - cumulative) - 1;
+  const float density = densities[bin];
+  const float t = density > 0.0f ? (unit - cumulative[bin]) / density
+                                 : 0.5f;
+
+  return 380.0f + bin + std::max(0.0f, std::min(1.0f, t));
+}
+
+Spectrum WavelengthDistribution::GetWavelengths(
+  const float heroWavelength) const
+{
+  // Recover where the hero wavelength lies in the distribution
+  const int bin = GetBin(heroWavelength);
+  const float unit = cumulative[bin]
+                   + (heroWavelength - 380.0f - bin) * densities[bin];
+
+  Spectrum wavelengths;
+  wavelengths[0] = heroWavelength;
+
+  for (int i = 1; i < Spectrum::size; i++)
+  {
+    float u = unit + static_cast<float>(i) / Spectrum::size;
+    if (u >= 1.0f) u -= 1.0f;
+    wavelengths[i] = Sample(u);
+  }
+
+  return wavelengths;
+}
+
+Spectrum WavelengthDistribution::GetWeights(const Spectrum wavelengths) const
+{
+  // A uniform distribution has density 1 / 400 per nm everywhere
+  Spectrum weights;
+  for (int i = 0; i < Spectrum::size; i++)
+  {
+    weights[i] = 1.0f / (densities[GetBin(wavelengths[i])] * 400.0f);
+  }
+  return weights;
+}
@@ -0,0 +1,72 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "RenderSettings.h"
+#include "Spectrum.h"
+
+namespace Luculentus
+{
+  class CompiledScene;
+
+  /// Decides how the wavelengths of paths are distributed over the
+  /// visible spectrum (380 .. 780 nm). Wavelengths that the observer
+  /// barely sees contribute little to the image, so they can be
+  /// sampled less often, as long as the photons are weighted
+  /// accordingly. The density is tabulated per nanometre, and samples
+  /// are taken through the inverse of its cumulative distribution.
+  class WavelengthDistribution
+  {
+    public:
+
+      /// The number of bins of the tabulated density, one per nm.
+      static const int numberOfBins = 400;
+
+      /// Tabulates the density for the specified kind of sampling. For
+      /// sampling proportional to the lights, the emissive materials of
+      /// the scene are taken into account.
+      WavelengthDistribution(const CompiledScene& scene,
+                             const RenderSettings::WavelengthSampling
+                             sampling);
+
+      /// Returns the wavelength (in nm) for a real in the range 0 .. 1.
+      float Sample(const float unit) const;
+
+      /// Returns the wavelengths (in nm) of the lanes of a path with the
+      /// specified hero wavelength. The lanes are spaced evenly after
+      /// the hero wavelength in the cumulative distribution, wrapping
+      /// around, so every lane on its own follows the distribution, and
+      /// together they are stratified.
+      Spectrum GetWavelengths(const float heroWavelength) const;
+
+      /// Returns the factor by which photons of the specified
+      /// wavelengths must be weighted, compared to uniform sampling.
+      Spectrum GetWeights(const Spectrum wavelengths) const;
+
+    private:
+
+      /// The probability density of every bin, per nm.
+      float densities[numberOfBins];
+
+      /// The cumulative distribution at the start of every bin, and
+      /// at the end of the last one.
+      float cumulative[numberOfBins + 1];
+
+      /// Returns the bin that contains the wavelength.
+      int GetBin(const float wavelength) const;
+  };
+}